@@ -0,0 +1,171 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "admission.h"
+
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+static const char *TAG = "admission";
+
+/**
+ * @brief Token bucket of a (source, command class) pair.
+ */
+typedef struct {
+    TickType_t lastRefill;
+    uint8_t tokens;
+} PDM_TokenBucket_t;
+
+/**
+ * @brief Event remembered for coalescing.
+ */
+typedef struct {
+    uint8_t source;
+    uint32_t data;
+} PDM_CoalesceKey_t;
+
+static const PDM_AdmissionRule_t *rules_ = NULL;
+static uint8_t sourceCount = 0;
+static uint8_t classCount = 0;
+static uint8_t ruleStride = 0; /**< Rules per source in rules_, as given to PDMAdmission_init.*/
+
+static PDM_TokenBucket_t buckets[PDM_ADMISSION_MAX_SOURCES][PDM_ADMISSION_MAX_CLASSES];
+static PDM_AdmissionStats_t stats[PDM_ADMISSION_MAX_SOURCES];
+static PDM_CoalesceKey_t batch[PDM_ADMISSION_COALESCE_SLOTS];
+static uint8_t batchCount = 0;
+
+/** Helpers ***************************************/
+static bool PDMAdmission_takeToken_(PDM_TokenBucket_t *bucket, const PDM_AdmissionRule_t *rule) {
+    if (rule->periodMs == 0) {
+        return true;
+    }
+    const TickType_t now = xTaskGetTickCount();
+    const TickType_t period = MAX(pdMS_TO_TICKS(rule->periodMs), 1);
+    const TickType_t earned = (now - bucket->lastRefill) / period;
+    if (earned > 0) {
+        bucket->tokens = MIN(bucket->tokens + earned, rule->burst);
+        bucket->lastRefill += earned * period;
+    }
+    if (bucket->tokens == 0) {
+        return false;
+    }
+    bucket->tokens--;
+    return true;
+}
+
+static uint8_t PDMAdmission_findLeader_(const uint8_t source, const uint32_t data) {
+    for (uint8_t i = 0; i < batchCount; i++) {
+        if (batch[i].source == source && batch[i].data == data) {
+            return i;
+        }
+    }
+    return PDM_ADMISSION_NO_LEADER;
+}
+
+static PDM_AdmitResult_t PDMAdmission_count_(const uint8_t source, const PDM_AdmitResult_t result) {
+    switch (result) {
+    case PDM_ADMIT_OK:        stats[source].admitted++;  break;
+    case PDM_ADMIT_DROPPED:   stats[source].dropped++;   break;
+    case PDM_ADMIT_COALESCED: stats[source].coalesced++; break;
+    case PDM_ADMIT_BUSY:      stats[source].busy++;      break;
+    }
+    return result;
+}
+
+/** Public Methods ********************************/
+void PDMAdmission_init(const PDM_AdmissionRule_t *rules, const uint8_t sources, const uint8_t classes) {
+    rules_ = rules;
+    ruleStride = classes; // Row length of the caller's table, even if fewer classes are limited.
+    sourceCount = MIN(sources, PDM_ADMISSION_MAX_SOURCES);
+    classCount = MIN(classes, PDM_ADMISSION_MAX_CLASSES);
+    if (sourceCount < sources || classCount < classes) {
+        ESP_LOGE(TAG, "Only %u sources x %u classes are limited, the rest is admitted", sourceCount, classCount);
+    }
+    const TickType_t now = xTaskGetTickCount();
+    for (uint8_t s = 0; s < sourceCount; s++) {
+        for (uint8_t c = 0; c < classCount; c++) {
+            buckets[s][c].lastRefill = now;
+            buckets[s][c].tokens = rules_[s * ruleStride + c].burst; // Start full.
+        }
+    }
+    memset(stats, 0, sizeof(stats));
+    batchCount = 0;
+}
+
+void PDMAdmission_beginBatch() {
+    batchCount = 0;
+}
+
+PDM_AdmitResult_t PDMAdmission_check(const uint8_t source, const uint8_t commandClass,
+                                     const uint32_t data, uint8_t *leader) {
+    *leader = PDM_ADMISSION_NO_LEADER;
+    if (rules_ == NULL || source >= sourceCount || commandClass >= classCount) {
+        return PDM_ADMIT_OK; // Nothing configured for it.
+    }
+    const PDM_AdmissionRule_t *rule = &rules_[source * ruleStride + commandClass];
+    const bool isCoalescing = rule->policy == PDM_OVERLOAD_COALESCE;
+    if (!PDMAdmission_takeToken_(&buckets[source][commandClass], rule)) {
+        // Only above the rate: within it every event gets its own dispatch.
+        *leader = isCoalescing ? PDMAdmission_findLeader_(source, data) : PDM_ADMISSION_NO_LEADER;
+        if (*leader != PDM_ADMISSION_NO_LEADER) {
+            return PDMAdmission_count_(source, PDM_ADMIT_COALESCED);
+        }
+        return PDMAdmission_count_(source, rule->policy == PDM_OVERLOAD_BUSY ? PDM_ADMIT_BUSY : PDM_ADMIT_DROPPED);
+    }
+    if (isCoalescing) {
+        *leader = PDMAdmission_findLeader_(source, data); // The latest identical event leads.
+        if (*leader == PDM_ADMISSION_NO_LEADER && batchCount < PDM_ADMISSION_COALESCE_SLOTS) {
+            batch[batchCount].source = source;
+            batch[batchCount].data = data;
+            *leader = batchCount++;
+        }
+    }
+    return PDMAdmission_count_(source, PDM_ADMIT_OK);
+}
+
+const PDM_AdmissionStats_t *PDMAdmission_stats(const uint8_t source) {
+    return &stats[source < PDM_ADMISSION_MAX_SOURCES ? source : 0];
+}
+
+void PDMAdmission_logStats() {
+    for (uint8_t s = 0; s < sourceCount; s++) {
+        const PDM_AdmissionStats_t *st = &stats[s];
+        if (st->admitted + st->dropped + st->coalesced + st->busy == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "source %d: admitted %u, dropped %u, coalesced %u, busy %u",
+                 s, st->admitted, st->dropped, st->coalesced, st->busy);
+    }
+}
\ No newline at end of file
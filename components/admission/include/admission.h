@@ -0,0 +1,134 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+/**
+ * @brief Admission control for incoming events.
+ * 
+ * Every (source, command class) pair gets a token bucket. Events within
+ * the rate are admitted; the rest are handled according to the policy
+ * of their rule. Above the rate, an event identical (same source and
+ * command) to one admitted earlier in the batch can be coalesced with
+ * it: it isn't dispatched, and gets the reply of that leader.
+*/
+#ifndef __PDM_ADMISSION__
+#define __PDM_ADMISSION__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PDM_ADMISSION_MAX_SOURCES 8  /**< Max number of sources.*/
+#define PDM_ADMISSION_MAX_CLASSES 4  /**< Max number of command classes.*/
+#define PDM_ADMISSION_COALESCE_SLOTS 8 /**< Distinct events remembered per batch for coalescing.*/
+#define PDM_ADMISSION_NO_LEADER UINT8_MAX /**< Event not remembered for coalescing.*/
+
+/**
+ * @brief What to do with events above the rate.
+ */
+typedef enum {
+    PDM_OVERLOAD_DROP = 0, /**< Drop silently.*/
+    PDM_OVERLOAD_COALESCE, /**< Merge with an identical event admitted in the batch, drop the rest.*/
+    PDM_OVERLOAD_BUSY,     /**< Drop, but let the sender know it should retry later.*/
+} PDM_OverloadPolicy_t;
+
+/**
+ * @brief Outcome of an admission check.
+ */
+typedef enum {
+    PDM_ADMIT_OK = 0,     /**< Dispatch the event.*/
+    PDM_ADMIT_DROPPED,    /**< Discard the event.*/
+    PDM_ADMIT_COALESCED,  /**< Discard and answer with the reply of the leader, admitted in this batch.*/
+    PDM_ADMIT_BUSY,       /**< Discard and reply busy.*/
+} PDM_AdmitResult_t;
+
+/**
+ * @brief Limits for one (source, command class) pair.
+ */
+typedef struct {
+    uint32_t periodMs;           /**< One token every periodMs. 0 means unlimited.*/
+    uint8_t burst;               /**< Max tokens saved up.*/
+    PDM_OverloadPolicy_t policy; /**< What to do above the rate.*/
+} PDM_AdmissionRule_t;
+
+/**
+ * @brief Outcome counters of a source.
+ */
+typedef struct {
+    uint32_t admitted;
+    uint32_t dropped;
+    uint32_t coalesced;
+    uint32_t busy;
+} PDM_AdmissionStats_t;
+
+/**
+ * @brief Initializes the module.
+ * 
+ * @param rules sources x classes rules, row-major by source. Must outlive the module.
+ * @param sources number of sources (rows).
+ * @param classes number of command classes (columns).
+ */
+void PDMAdmission_init(const PDM_AdmissionRule_t *rules, const uint8_t sources, const uint8_t classes);
+
+/**
+ * @brief Starts a new batch, forgetting the events remembered for coalescing.
+ * 
+ * Also to be called once an event that may change what they'd answer
+ * (e.g. a state change) is admitted.
+ */
+void PDMAdmission_beginBatch();
+
+/**
+ * @brief Decides what to do with an event.
+ * 
+ * Events admitted under a coalescing rule are remembered as leaders,
+ * each in a slot, until the next PDMAdmission_beginBatch.
+ * 
+ * @param source where the event came from.
+ * @param commandClass class of the command, as defined by the application.
+ * @param data event data, including anything that tells identical events apart (e.g. target instance).
+ * @param[out] leader slot of the event, if admitted as a leader, or of its
+ *             leader, if coalesced. PDM_ADMISSION_NO_LEADER otherwise.
+ * 
+ * @return outcome, already counted in the stats of the source.
+ */
+PDM_AdmitResult_t PDMAdmission_check(const uint8_t source, const uint8_t commandClass,
+                                     const uint32_t data, uint8_t *leader);
+
+/**
+ * @brief Gets the outcome counters of a source.
+ */
+const PDM_AdmissionStats_t *PDMAdmission_stats(const uint8_t source);
+
+/**
+ * @brief Logs the counters of every source that saw events.
+ */
+void PDMAdmission_logStats();
+
+#endif // __PDM_ADMISSION__
\ No newline at end of file
@@ -32,10 +32,13 @@
 
 #include <stdio.h>
 #include "bluetooth_client.h"
+#include "bt_bonds.h"
+#include "esp_timer.h"
 
 
 #include <stdint.h>
 #include <string.h>
+#include <sys/param.h>
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -53,7 +56,124 @@ static struct timeval time_old;
 static const esp_spp_sec_t sec_mask = ESP_SPP_SEC_AUTHENTICATE;
 static const esp_spp_role_t role_slave = ESP_SPP_ROLE_SLAVE;
 
-static IntConsumer_t callback;
+/**
+ * @brief State of a connected peer.
+ * 
+ * Filled by the BT task (core 0) and drained by the main loop, which may
+ * run on the other core. Each of handle, rxHead and rxTail has a single
+ * writer, and is published with a release store and read with an
+ * acquire load, so the data written before it is seen with it.
+ */
+typedef struct {
+    uint32_t handle;                       /**< SPP handle, 0 if the slot is free. Written by the BT task.*/
+    esp_bd_addr_t bda;                     /**< Address of the peer.*/
+    PDM_CommandParser_t parser;            /**< Framing of the commands being received. Used by the BT task only.*/
+    uint32_t rx[PDM_BT_SESSION_RX_LEN];    /**< Commands parsed, waiting to be forwarded.*/
+    uint8_t rxHead;                        /**< Written by the BT task.*/
+    uint8_t rxTail;                        /**< Written by the main loop.*/
+} PDM_BtSession_t;
+
+/** Pairing **************************************/
+/** Scan mode is only set from the main loop; the BT task asks for it through isScanModeDue.*/
+static bool isScanModeDue = false; /**< Set by the BT task once SPP is up. Atomic.*/
+static bool isScanModeSet = false; /**< Main loop only.*/
+static bool isDiscoverable = false; /**< Main loop only.*/
+static int64_t setupStartUs = 0;    /**< When the ACL link of the connection being set up came up, 0 if none.*/
+static bool isSetupBonded = false;  /**< Whether that connection is from a bonded peer.*/
+
+static PDM_BtSession_t sessions[PDM_BT_MAX_SESSIONS];
+static uint8_t nextSession = 0; /**< Round-robin cursor for PDMBluetooth_poll_.*/
+
+static bool PDMBluetooth_init_(PDM_Transport_t *transport);
+static void PDMBluetooth_poll_(PDM_Transport_t *transport);
+static bool PDMBluetooth_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value);
+
+static const PDM_TransportOps_t bluetoothOps = {
+    .init = PDMBluetooth_init_,
+    .poll = PDMBluetooth_poll_,
+    .send = PDMBluetooth_send_,
+};
+
+static PDM_Transport_t bluetoothTransport = {
+    .name = "bt",
+    .ops = &bluetoothOps,
+};
+
+/** Pairing Helpers *******************************/
+/** New peers can pair if nobody is bonded yet or the pairing window is still open. */
+static bool PDMBluetooth_isPairingOpen_() {
+    return PDMBtBonds_count() == 0 || CONFIG_PDM_BT_PAIRING_WINDOW_S == 0 ||
+           esp_timer_get_time() < (int64_t)CONFIG_PDM_BT_PAIRING_WINDOW_S * 1000000;
+}
+
+static void PDMBluetooth_updateScanMode_(const bool force) {
+    bool shouldBeDiscoverable = true;
+#ifdef CONFIG_PDM_BT_HIDE_WHEN_BONDED
+    shouldBeDiscoverable = PDMBluetooth_isPairingOpen_();
+#endif
+    if (!force && (!isScanModeSet || shouldBeDiscoverable == isDiscoverable)) {
+        return;
+    }
+    isScanModeSet = true;
+    isDiscoverable = shouldBeDiscoverable;
+    ESP_LOGI(SPP_TAG, "Now %s", isDiscoverable ? "discoverable" : "connectable only");
+    esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE,
+                             isDiscoverable ? ESP_BT_GENERAL_DISCOVERABLE : ESP_BT_NON_DISCOVERABLE);
+}
+
+/** Sessions **************************************/
+static PDM_BtSession_t *PDMBluetooth_findSession_(const uint32_t handle) {
+    for (uint8_t i = 0; i < PDM_BT_MAX_SESSIONS; i++) {
+        if (__atomic_load_n(&sessions[i].handle, __ATOMIC_ACQUIRE) == handle) {
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static void PDMBluetooth_openSession_(const uint32_t handle, const esp_bd_addr_t bda) {
+    PDM_BtSession_t *session = PDMBluetooth_findSession_(0);
+    if (session == NULL) {
+        ESP_LOGE(SPP_TAG, "No free session for handle %d, disconnecting", handle);
+        esp_spp_disconnect(handle);
+        return;
+    }
+    memcpy(session->bda, bda, sizeof(esp_bd_addr_t));
+    memset(&session->parser, 0, sizeof(session->parser)); // Whatever was half received belongs to the old peer.
+    // Empty ring, without touching rxTail: it belongs to the main loop.
+    __atomic_store_n(&session->rxHead, __atomic_load_n(&session->rxTail, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    __atomic_store_n(&session->handle, handle, __ATOMIC_RELEASE); // Published last, the main loop skips free slots.
+    ESP_LOGI(SPP_TAG, "Session %d opened for handle %d", session - sessions, handle);
+    if (setupStartUs != 0) {
+        ESP_LOGI(SPP_TAG, "Connection setup took %lld ms (%s peer)",
+                 (esp_timer_get_time() - setupStartUs) / 1000, isSetupBonded ? "bonded" : "new");
+        setupStartUs = 0;
+    }
+}
+
+static void PDMBluetooth_closeSession_(const uint32_t handle) {
+    PDM_BtSession_t *session = PDMBluetooth_findSession_(handle);
+    if (session != NULL) {
+        __atomic_store_n(&session->handle, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/** Parses the commands of a chunk, framed as for TCP. A command may span chunks. */
+static void PDMBluetooth_parse_(PDM_BtSession_t *session, const uint8_t *data, const uint16_t len) {
+    for (uint16_t i = 0; i < len; i++) {
+        uint32_t value;
+        if (!PDMTransport_parseCommand(&session->parser, data[i], &value)) {
+            continue;
+        }
+        const uint8_t head = session->rxHead;
+        if ((uint8_t)(head - __atomic_load_n(&session->rxTail, __ATOMIC_ACQUIRE)) >= PDM_BT_SESSION_RX_LEN) {
+            ESP_LOGE(SPP_TAG, "Handle %d sends too fast, dropping commands", session->handle);
+            return;
+        }
+        session->rx[head & (PDM_BT_SESSION_RX_LEN - 1)] = value;
+        __atomic_store_n(&session->rxHead, head + 1, __ATOMIC_RELEASE); // Publishes the command.
+    }
+}
 
 
 static void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
@@ -62,7 +182,7 @@ static void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
     case ESP_SPP_INIT_EVT:
         ESP_LOGI(SPP_TAG, "ESP_SPP_INIT_EVT");
         esp_bt_dev_set_device_name(EXAMPLE_DEVICE_NAME);
-        esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_GENERAL_DISCOVERABLE);
+        __atomic_store_n(&isScanModeDue, true, __ATOMIC_RELEASE); // Set by the next poll.
         esp_spp_start_srv(sec_mask,role_slave, 0, SPP_SERVER_NAME);
         break;
     case ESP_SPP_DISCOVERY_COMP_EVT:
@@ -73,6 +193,7 @@ static void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
         break;
     case ESP_SPP_CLOSE_EVT:
         ESP_LOGI(SPP_TAG, "ESP_SPP_CLOSE_EVT");
+        PDMBluetooth_closeSession_(param->close.handle);
         break;
     case ESP_SPP_START_EVT:
         ESP_LOGI(SPP_TAG, "ESP_SPP_START_EVT");
@@ -80,11 +201,15 @@ static void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
     case ESP_SPP_CL_INIT_EVT:
         ESP_LOGI(SPP_TAG, "ESP_SPP_CL_INIT_EVT");
         break;
-    case ESP_SPP_DATA_IND_EVT:
+    case ESP_SPP_DATA_IND_EVT: {
         ESP_LOGI(SPP_TAG, "ESP_SPP_DATA_IND_EVT len=%d handle=%d",
                  param->data_ind.len, param->data_ind.handle);
-        callback(param->data_ind.data[0]-0x30); // TODO: safety checks.
+        PDM_BtSession_t *session = PDMBluetooth_findSession_(param->data_ind.handle);
+        if (session != NULL) {
+            PDMBluetooth_parse_(session, param->data_ind.data, param->data_ind.len);
+        }
         break;
+    }
     case ESP_SPP_CONG_EVT:
         ESP_LOGI(SPP_TAG, "ESP_SPP_CONG_EVT");
         break;
@@ -93,6 +218,7 @@ static void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
         break;
     case ESP_SPP_SRV_OPEN_EVT:
         ESP_LOGI(SPP_TAG, "ESP_SPP_SRV_OPEN_EVT");
+        PDMBluetooth_openSession_(param->srv_open.handle, param->srv_open.rem_bda);
         gettimeofday(&time_old, NULL);
         break;
     case ESP_SPP_SRV_STOP_EVT:
@@ -109,29 +235,41 @@ static void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
 static void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
 {
     switch (event) {
+    case ESP_BT_GAP_ACL_CONN_CMPL_STAT_EVT:
+        // Setup is timed from the link coming up, whether the peer pairs or is already bonded.
+        if (param->acl_conn_cmpl_stat.stat == ESP_BT_STATUS_SUCCESS) {
+            setupStartUs = esp_timer_get_time();
+            isSetupBonded = PDMBtBonds_isKnown(param->acl_conn_cmpl_stat.bda);
+        }
+        break;
+    case ESP_BT_GAP_ACL_DISCONN_CMPL_STAT_EVT:
+        setupStartUs = 0; // Dropped before SPP opened, or already timed.
+        break;
     case ESP_BT_GAP_AUTH_CMPL_EVT:{
         if (param->auth_cmpl.stat == ESP_BT_STATUS_SUCCESS) {
             ESP_LOGI(SPP_TAG, "authentication success: %s", param->auth_cmpl.device_name);
             esp_log_buffer_hex(SPP_TAG, param->auth_cmpl.bda, ESP_BD_ADDR_LEN);
+            PDMBtBonds_touch(param->auth_cmpl.bda); // The next poll hides the device if it should.
         } else {
+            setupStartUs = 0;
             ESP_LOGE(SPP_TAG, "authentication failed, status:%d", param->auth_cmpl.stat);
         }
         break;
     }
     case ESP_BT_GAP_PIN_REQ_EVT:{
         ESP_LOGI(SPP_TAG, "ESP_BT_GAP_PIN_REQ_EVT min_16_digit:%d", param->pin_req.min_16_digit);
-        if (param->pin_req.min_16_digit) {
+        esp_bt_pin_code_t pin_code = {0};
+        if (!PDMBluetooth_isPairingOpen_()) {
+            ESP_LOGE(SPP_TAG, "Pairing closed, rejecting new peer");
+            esp_bt_gap_pin_reply(param->pin_req.bda, false, 0, pin_code);
+        } else if (param->pin_req.min_16_digit) {
             ESP_LOGI(SPP_TAG, "Input pin code: 0000 0000 0000 0000");
-            esp_bt_pin_code_t pin_code = {0};
             esp_bt_gap_pin_reply(param->pin_req.bda, true, 16, pin_code);
         } else {
-            ESP_LOGI(SPP_TAG, "Input pin code: 1234");
-            esp_bt_pin_code_t pin_code;
-            pin_code[0] = '1';
-            pin_code[1] = '2';
-            pin_code[2] = '3';
-            pin_code[3] = '4';
-            esp_bt_gap_pin_reply(param->pin_req.bda, true, 4, pin_code);
+            const uint8_t pinLen = MIN(strlen(CONFIG_PDM_BT_PIN), sizeof(esp_bt_pin_code_t));
+            memcpy(pin_code, CONFIG_PDM_BT_PIN, pinLen);
+            ESP_LOGI(SPP_TAG, "Input the configured pin code");
+            esp_bt_gap_pin_reply(param->pin_req.bda, true, pinLen, pin_code);
         }
         break;
     }
@@ -139,7 +277,10 @@ static void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *pa
 #if (CONFIG_BT_SSP_ENABLED == true)
     case ESP_BT_GAP_CFM_REQ_EVT:
         ESP_LOGI(SPP_TAG, "ESP_BT_GAP_CFM_REQ_EVT Please compare the numeric value: %d", param->cfm_req.num_val);
-        esp_bt_gap_ssp_confirm_reply(param->cfm_req.bda, true);
+        if (!PDMBluetooth_isPairingOpen_()) {
+            ESP_LOGE(SPP_TAG, "Pairing closed, rejecting new peer");
+        }
+        esp_bt_gap_ssp_confirm_reply(param->cfm_req.bda, PDMBluetooth_isPairingOpen_());
         break;
     case ESP_BT_GAP_KEY_NOTIF_EVT:
         ESP_LOGI(SPP_TAG, "ESP_BT_GAP_KEY_NOTIF_EVT passkey:%d", param->key_notif.passkey);
@@ -187,6 +328,8 @@ void PDMBluetooth_btInit(void)
         return;
     }
 
+    PDMBtBonds_load();
+
     if ((ret = esp_bt_gap_register_callback(esp_bt_gap_cb)) != ESP_OK) {
         ESP_LOGE(SPP_TAG, "%s gap register failed: %s\n", __func__, esp_err_to_name(ret));
         return;
@@ -210,11 +353,44 @@ void PDMBluetooth_btInit(void)
     esp_bt_gap_set_pin(pin_type, 0, pin_code);
 }
 
-void PDMBluetooth_init(IntConsumer_t onDataReceived) {
-    callback = onDataReceived;
+static bool PDMBluetooth_init_(PDM_Transport_t *transport) {
     PDMBluetooth_btInit();
+    return true;
+}
+
+static void PDMBluetooth_poll_(PDM_Transport_t *transport) {
+    // Hides the device once the pairing window closes, or a first peer bonds after it.
+    PDMBluetooth_updateScanMode_(__atomic_exchange_n(&isScanModeDue, false, __ATOMIC_ACQ_REL));
+    // One command per peer per pass, until the transport can't take more.
+    bool forwarded = true;
+    while (forwarded) {
+        forwarded = false;
+        for (uint8_t i = 0; i < PDM_BT_MAX_SESSIONS; i++) {
+            PDM_BtSession_t *session = &sessions[(nextSession + i) % PDM_BT_MAX_SESSIONS];
+            const uint32_t handle = __atomic_load_n(&session->handle, __ATOMIC_ACQUIRE);
+            const uint8_t tail = session->rxTail;
+            if (handle == 0 || __atomic_load_n(&session->rxHead, __ATOMIC_ACQUIRE) == tail) {
+                continue;
+            }
+            if (PDMTransport_rxSpace(transport) == 0) {
+                nextSession = (nextSession + i) % PDM_BT_MAX_SESSIONS; // Resume here next time.
+                return;
+            }
+            PDMTransport_notify(transport, handle, session->rx[tail & (PDM_BT_SESSION_RX_LEN - 1)]);
+            __atomic_store_n(&session->rxTail, tail + 1, __ATOMIC_RELEASE); // Hands the slot back.
+            forwarded = true;
+        }
+    }
+}
+
+static bool PDMBluetooth_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value) {
+    if (peer == 0 || PDMBluetooth_findSession_(peer) == NULL) {
+        return true; // Peer is gone, drop it.
+    }
+    uint8_t data = value + 0x30;
+    return esp_spp_write(peer, sizeof(data), &data) == ESP_OK;
 }
 
-void PDMBluetooth_task() {
-    ;
+PDM_Transport_t *PDMBluetooth_transport() {
+    return &bluetoothTransport;
 }
\ No newline at end of file
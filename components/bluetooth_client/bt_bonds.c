@@ -0,0 +1,213 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "bt_bonds.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char *TAG = "bt_bonds";
+
+/**
+ * @brief A trusted peer. Stored as-is in NVS.
+ */
+typedef struct {
+    esp_bd_addr_t bda;  /**< Address of the peer.*/
+    uint8_t isUsed;     /**< Whether the slot holds a peer.*/
+    uint8_t reserved;
+    uint32_t lastSeen;  /**< LRU stamp, bumped every time the peer authenticates. Saved with the next add.*/
+} PDM_BtBond_t;
+
+static PDM_BtBond_t bonds[CONFIG_PDM_BT_MAX_BONDS];
+static uint32_t lastStamp = 0;
+/** Guards bonds and lastStamp: the BT task adds peers while the main loop counts them. */
+static SemaphoreHandle_t lock = NULL;
+
+/** Helpers ***************************************/
+/** Nothing to guard before the store is loaded: the BT callbacks aren't registered yet. */
+static void PDMBtBonds_lock_() {
+    if (lock != NULL) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+    }
+}
+
+static void PDMBtBonds_unlock_() {
+    if (lock != NULL) {
+        xSemaphoreGive(lock);
+    }
+}
+
+static PDM_BtBond_t *PDMBtBonds_find_(const esp_bd_addr_t bda) {
+    for (uint8_t i = 0; i < CONFIG_PDM_BT_MAX_BONDS; i++) {
+        if (bonds[i].isUsed && memcmp(bonds[i].bda, bda, sizeof(esp_bd_addr_t)) == 0) {
+            return &bonds[i];
+        }
+    }
+    return NULL;
+}
+
+static PDM_BtBond_t *PDMBtBonds_free_() {
+    for (uint8_t i = 0; i < CONFIG_PDM_BT_MAX_BONDS; i++) {
+        if (!bonds[i].isUsed) {
+            return &bonds[i];
+        }
+    }
+    return NULL;
+}
+
+static PDM_BtBond_t *PDMBtBonds_leastRecent_() {
+    PDM_BtBond_t *oldest = &bonds[0];
+    for (uint8_t i = 1; i < CONFIG_PDM_BT_MAX_BONDS; i++) {
+        if (bonds[i].lastSeen < oldest->lastSeen) {
+            oldest = &bonds[i];
+        }
+    }
+    return oldest;
+}
+
+/** Writes a copy taken under the lock, so NVS doesn't hold it. */
+static void PDMBtBonds_save_(const PDM_BtBond_t *snapshot) {
+    nvs_handle_t nvs;
+    if (nvs_open(PDM_BT_BONDS_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to open NVS, bonds won't be persisted");
+        return;
+    }
+    nvs_set_blob(nvs, "peers", snapshot, sizeof(bonds));
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+/** Public Methods ********************************/
+void PDMBtBonds_load() {
+    if (lock == NULL) {
+        lock = xSemaphoreCreateMutex();
+    }
+    PDMBtBonds_lock_();
+    memset(bonds, 0, sizeof(bonds));
+    nvs_handle_t nvs;
+    if (nvs_open(PDM_BT_BONDS_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        size_t len = sizeof(bonds);
+        if (nvs_get_blob(nvs, "peers", bonds, &len) != ESP_OK || len != sizeof(bonds)) {
+            memset(bonds, 0, sizeof(bonds)); // Missing or sized for another CONFIG_PDM_BT_MAX_BONDS.
+        }
+        nvs_close(nvs);
+    }
+
+    // The stack owns the link keys: drop peers it forgot, adopt bonds we don't know.
+    int stackCount = esp_bt_gap_get_bond_device_num();
+    esp_bd_addr_t *stackBonds = stackCount > 0 ? malloc(stackCount * sizeof(esp_bd_addr_t)) : NULL;
+    if (stackCount > 0 && (stackBonds == NULL ||
+                           esp_bt_gap_get_bond_device_list(&stackCount, stackBonds) != ESP_OK)) {
+        stackCount = 0;
+    }
+    bool isDirty = false;
+    for (uint8_t i = 0; i < CONFIG_PDM_BT_MAX_BONDS; i++) {
+        bool isInStack = false;
+        for (int j = 0; j < stackCount && bonds[i].isUsed && !isInStack; j++) {
+            isInStack = memcmp(bonds[i].bda, stackBonds[j], sizeof(esp_bd_addr_t)) == 0;
+        }
+        if (bonds[i].isUsed && !isInStack) {
+            bonds[i].isUsed = false;
+            isDirty = true;
+        }
+        if (bonds[i].isUsed && bonds[i].lastSeen > lastStamp) {
+            lastStamp = bonds[i].lastSeen;
+        }
+    }
+    for (int j = 0; j < stackCount; j++) {
+        if (PDMBtBonds_find_(stackBonds[j]) != NULL) {
+            continue;
+        }
+        PDM_BtBond_t *slot = PDMBtBonds_free_();
+        if (slot == NULL) {
+            esp_bt_gap_remove_bond_device(stackBonds[j]);
+            continue;
+        }
+        memcpy(slot->bda, stackBonds[j], sizeof(esp_bd_addr_t));
+        slot->isUsed = true;
+        slot->lastSeen = 0;
+        isDirty = true;
+    }
+    free(stackBonds);
+    PDM_BtBond_t snapshot[CONFIG_PDM_BT_MAX_BONDS];
+    memcpy(snapshot, bonds, sizeof(bonds));
+    PDMBtBonds_unlock_();
+    if (isDirty) {
+        PDMBtBonds_save_(snapshot);
+    }
+    ESP_LOGI(TAG, "%d bonded peers", PDMBtBonds_count());
+}
+
+bool PDMBtBonds_isKnown(const esp_bd_addr_t bda) {
+    PDMBtBonds_lock_();
+    const bool isKnown = PDMBtBonds_find_(bda) != NULL;
+    PDMBtBonds_unlock_();
+    return isKnown;
+}
+
+uint8_t PDMBtBonds_count() {
+    uint8_t count = 0;
+    PDMBtBonds_lock_();
+    for (uint8_t i = 0; i < CONFIG_PDM_BT_MAX_BONDS; i++) {
+        count += bonds[i].isUsed;
+    }
+    PDMBtBonds_unlock_();
+    return count;
+}
+
+void PDMBtBonds_touch(const esp_bd_addr_t bda) {
+    PDMBtBonds_lock_();
+    PDM_BtBond_t *bond = PDMBtBonds_find_(bda);
+    const bool isNew = bond == NULL;
+    if (bond == NULL) {
+        bond = PDMBtBonds_free_();
+    }
+    if (bond == NULL) {
+        bond = PDMBtBonds_leastRecent_();
+        ESP_LOGI(TAG, "Store full, forgetting least recently seen peer");
+        esp_bt_gap_remove_bond_device(bond->bda);
+    }
+    memcpy(bond->bda, bda, sizeof(esp_bd_addr_t));
+    bond->isUsed = true;
+    bond->lastSeen = ++lastStamp;
+    PDM_BtBond_t snapshot[CONFIG_PDM_BT_MAX_BONDS];
+    memcpy(snapshot, bonds, sizeof(bonds));
+    PDMBtBonds_unlock_();
+    // A known peer coming back only moves in RAM: flash is written when the set of peers changes.
+    if (isNew) {
+        PDMBtBonds_save_(snapshot);
+    }
+}
\ No newline at end of file
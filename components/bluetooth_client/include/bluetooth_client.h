@@ -42,29 +42,22 @@
 #include "esp_gap_bt_api.h"
 #include "esp_bt_device.h"
 #include "esp_spp_api.h"
+#include "transport.h"
 
 #define EXAMPLE_DEVICE_NAME "ESP_SPP_ACCEPTOR"
-
-
-typedef void(*IntConsumer_t)(const uint32_t value);
+#define PDM_BT_MAX_SESSIONS CONFIG_BTDM_CTRL_BR_EDR_MAX_ACL_CONN /**< Peers served at the same time.*/
+#define PDM_BT_SESSION_RX_LEN 8 /**< Commands buffered per peer. Must be a power of two.*/
 
 /**
- * @brief Initializes the Bluetooth module.
+ * @brief Gets the Bluetooth Serial transport.
  * 
  * This module listens to Bluetooth Serial commands received from
- *  a Bluetooth Classic and forwards them to a handler.
- * 
- * @param onDataReceived handler that will consume captured messages.
+ *  up to PDM_BT_MAX_SESSIONS Bluetooth Classic devices at once. Every
+ *  digit received is a command; peers are served round-robin so a
+ *  chatty one can't starve the rest. The peer of each message is its
+ *  SPP handle, so replies go back to the device that sent the command.
  */
-void PDMBluetooth_init(IntConsumer_t onDataReceived);
-
-/** 
- * @brief Task to be run in the main loop of an application
- *        to keep the module going. 
- * @note Currently does nothing, but it's present so as to be
- *       consistent with the other modules of the PDM project.
-*/
-void PDMBluetooth_task();
+PDM_Transport_t *PDMBluetooth_transport();
 
 /**
  * @brief Deinitializes the Bluetooth module.
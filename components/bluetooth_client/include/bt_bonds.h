@@ -0,0 +1,77 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+/**
+ * @brief Store of trusted (bonded) Bluetooth peers.
+ * 
+ * Link keys are kept by the Bluetooth stack itself; this store tracks
+ * which peers are trusted and when they were last seen, in NVS, so the
+ * least recently seen peer can be evicted (keys included) when full.
+ * 
+ * Safe to call from the BT task and the main loop at once. NVS is only
+ * written when a peer is added or evicted; the last seen stamps of
+ * returning peers are saved along with it.
+*/
+#ifndef __PDM_BT_BONDS__
+#define __PDM_BT_BONDS__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_gap_bt_api.h"
+
+#define PDM_BT_BONDS_NVS_NAMESPACE "pdm_bt"
+
+/**
+ * @brief Loads the store and reconciles it with the bonds of the stack.
+ * 
+ * @note Bluedroid must be enabled before calling this function.
+ */
+void PDMBtBonds_load();
+
+/**
+ * @brief Whether a peer is bonded.
+ */
+bool PDMBtBonds_isKnown(const esp_bd_addr_t bda);
+
+/**
+ * @brief Number of bonded peers.
+ */
+uint8_t PDMBtBonds_count();
+
+/**
+ * @brief Records that a peer authenticated, adding it if new.
+ * 
+ * Evicts the least recently seen peer if the store is full. Only
+ * writes NVS if the peer is new.
+ */
+void PDMBtBonds_touch(const esp_bd_addr_t bda);
+
+#endif // __PDM_BT_BONDS__
\ No newline at end of file
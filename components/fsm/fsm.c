@@ -0,0 +1,102 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "fsm.h"
+
+#include <string.h>
+#include "esp_timer.h"
+
+/** Helpers ***************************************/
+static const PDM_FsmEntry_t *PDMFsm_find_(const PDM_Fsm_t *fsm, const PDM_FsmState_t state,
+                                          const PDM_FsmEvent_t *event) {
+    for (size_t i = 0; i < fsm->tableLen; i++) {
+        const PDM_FsmEntry_t *entry = &fsm->table[i];
+        if (entry->currentState == state &&
+            entry->event.source == event->source &&
+            entry->event.data == event->data) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool PDMFsm_dispatchOne_(PDM_Fsm_t *fsm, const PDM_FsmEvent_t *event) {
+    if (event->instance >= fsm->instanceCount) {
+        if (fsm->observer != NULL) {
+            const PDM_FsmDispatch_t rejection = {.event = event, .rejected = true};
+            fsm->observer(&rejection);
+        }
+        return false;
+    }
+    PDM_FsmState_t *state = &fsm->states[event->instance];
+    PDM_FsmDispatch_t dispatch = {
+        .event = event,
+        .prevState = *state,
+        .nextState = *state,
+        .handlerUs = 0,
+        .matched = false,
+        .rejected = false,
+    };
+    const PDM_FsmEntry_t *entry = PDMFsm_find_(fsm, *state, event);
+    if (entry != NULL) {
+        const int64_t startUs = esp_timer_get_time();
+        entry->handler(event, *state);
+        dispatch.handlerUs = esp_timer_get_time() - startUs;
+        *state = entry->nextState;
+        dispatch.nextState = entry->nextState;
+        dispatch.matched = true;
+    }
+    if (fsm->observer != NULL) {
+        fsm->observer(&dispatch);
+    }
+    return dispatch.matched;
+}
+
+/** Public Methods ********************************/
+void PDMFsm_init(PDM_Fsm_t *fsm, const PDM_FsmEntry_t *table, const size_t tableLen,
+                 PDM_FsmState_t *states, const uint16_t instanceCount,
+                 const PDM_FsmState_t initialState, const PDM_FsmObserver_t observer) {
+    fsm->table = table;
+    fsm->tableLen = tableLen;
+    fsm->states = states;
+    fsm->instanceCount = instanceCount;
+    fsm->observer = observer;
+    memset(states, initialState, instanceCount * sizeof(PDM_FsmState_t));
+}
+
+size_t PDMFsm_dispatch(PDM_Fsm_t *fsm, const PDM_FsmEvent_t *events, const size_t count) {
+    size_t matched = 0;
+    for (size_t i = 0; i < count; i++) {
+        matched += PDMFsm_dispatchOne_(fsm, &events[i]);
+    }
+    return matched;
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+/**
+ * @brief Table driven FSM engine.
+ * 
+ * A table describes one kind of machine; any number of instances of it
+ * run side by side. The state of every instance lives in one contiguous
+ * array owned by the caller, one byte per instance, and every event
+ * names the instance it targets.
+*/
+#ifndef __PDM_FSM__
+#define __PDM_FSM__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint8_t PDM_FsmState_t;
+
+/**
+ * @brief Event fed to the FSM.
+ */
+typedef struct {
+    uint8_t source;    /**< Source of the event (e.g. transport id).*/
+    uint32_t data;     /**< Data received.*/
+    uint32_t peer;     /**< Sender within the source. Not matched by the table.*/
+    uint16_t instance; /**< Instance the event targets. Not matched by the table.*/
+} PDM_FsmEvent_t;
+
+/**
+ * @brief Handler run when an entry matches.
+ * 
+ * @param event event being processed.
+ * @param state state of the target instance before the transition.
+ */
+typedef void (*PDM_FsmHandler_t)(const PDM_FsmEvent_t *event, const PDM_FsmState_t state);
+
+/**
+ * @brief FSM Entry for the state table. 
+ */
+typedef struct {
+    PDM_FsmState_t currentState; /**< State where the instance currently is.*/
+    PDM_FsmEvent_t event;        /**< Relevant event (source and data) for the current state.*/
+    PDM_FsmState_t nextState;    /**< State to move to after the event is processed.*/
+    PDM_FsmHandler_t handler;    /**< Handler to be run when the event happens.*/
+} PDM_FsmEntry_t;
+
+/**
+ * @brief Outcome of a dispatch, given to the observer.
+ */
+typedef struct {
+    const PDM_FsmEvent_t *event;
+    PDM_FsmState_t prevState;
+    PDM_FsmState_t nextState;
+    uint32_t handlerUs; /**< Time spent in the handler.*/
+    bool matched;       /**< An entry matched the event.*/
+    bool rejected;      /**< The target instance doesn't exist: nothing was looked up or run.*/
+} PDM_FsmDispatch_t;
+
+/**
+ * @brief Called after every dispatch (e.g. to drive actuators or trace).
+ */
+typedef void (*PDM_FsmObserver_t)(const PDM_FsmDispatch_t *dispatch);
+
+/**
+ * @brief An FSM table and the instances running it.
+ */
+typedef struct {
+    const PDM_FsmEntry_t *table; /**< Transitions, shared by every instance.*/
+    size_t tableLen;
+    PDM_FsmState_t *states;      /**< Current state of every instance, contiguous.*/
+    uint16_t instanceCount;
+    PDM_FsmObserver_t observer;  /**< May be NULL.*/
+} PDM_Fsm_t;
+
+/**
+ * @brief Initializes an FSM, putting every instance in the initial state.
+ * 
+ * @param fsm FSM to initialize.
+ * @param table transitions. Must outlive the FSM.
+ * @param tableLen number of entries in table.
+ * @param states room for instanceCount states. Must outlive the FSM.
+ * @param instanceCount number of instances.
+ * @param initialState state every instance starts in.
+ * @param observer called after every dispatch. May be NULL.
+ */
+void PDMFsm_init(PDM_Fsm_t *fsm, const PDM_FsmEntry_t *table, const size_t tableLen,
+                 PDM_FsmState_t *states, const uint16_t instanceCount,
+                 const PDM_FsmState_t initialState, const PDM_FsmObserver_t observer);
+
+/**
+ * @brief Dispatches a batch of events, in order, in one pass.
+ * 
+ * Events targeting an instance that doesn't exist are rejected before
+ * the table is looked up: they leave every state alone and only reach
+ * the observer, flagged as rejected.
+ * 
+ * @return number of events that matched an entry.
+ */
+size_t PDMFsm_dispatch(PDM_Fsm_t *fsm, const PDM_FsmEvent_t *events, const size_t count);
+
+/**
+ * @brief Gets the current state of an instance.
+ */
+static inline PDM_FsmState_t PDMFsm_state(const PDM_Fsm_t *fsm, const uint16_t instance) {
+    return fsm->states[instance];
+}
+
+#endif // __PDM_FSM__
\ No newline at end of file
@@ -0,0 +1,150 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "fsm_trace.h"
+
+#include <string.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#ifdef CONFIG_PDM_TRACE_FLASH
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#endif
+
+static const char *TAG = "fsm_trace";
+
+/** RAM Ring **************************************/
+static PDM_TraceRecord_t ring[CONFIG_PDM_TRACE_RING_LEN];
+static uint16_t ringHead = 0;  /**< Next slot to be written.*/
+static uint16_t ringCount = 0; /**< Valid records in the ring.*/
+static uint16_t ringUnflushed = 0; /**< Newest records not written to flash yet.*/
+
+#ifdef CONFIG_PDM_TRACE_FLASH
+/** Flash Flushing ********************************/
+_Static_assert(sizeof(PDM_TraceSectorHeader_t) + sizeof(ring) <= SPI_FLASH_SEC_SIZE,
+               "A full trace ring must fit in a flash sector");
+
+static const esp_partition_t *partition = NULL;
+static uint32_t sectorCount = 0;
+static uint32_t nextSector = 0;
+static uint32_t nextSequence = 0;
+#endif
+
+void PDMTrace_init() {
+    ringHead = 0;
+    ringCount = 0;
+    ringUnflushed = 0;
+#ifdef CONFIG_PDM_TRACE_FLASH
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         PDM_TRACE_PARTITION);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "No \"%s\" partition, trace will stay in RAM", PDM_TRACE_PARTITION);
+        return;
+    }
+    sectorCount = partition->size / SPI_FLASH_SEC_SIZE;
+    for (uint32_t i = 0; i < sectorCount; i++) {
+        PDM_TraceSectorHeader_t header;
+        if (esp_partition_read(partition, i * SPI_FLASH_SEC_SIZE, &header, sizeof(header)) != ESP_OK) {
+            continue;
+        }
+        if (header.magic == PDM_TRACE_MAGIC && header.sequence >= nextSequence) {
+            nextSequence = header.sequence + 1;
+            nextSector = (i + 1) % sectorCount;
+        }
+    }
+    ESP_LOGI(TAG, "Flushing to sector %u of %u, sequence %u", nextSector, sectorCount, nextSequence);
+#endif
+}
+
+void PDMTrace_record(const PDM_TraceRecord_t *record) {
+    ring[ringHead] = *record;
+    ringHead = (ringHead + 1) % CONFIG_PDM_TRACE_RING_LEN;
+    if (ringCount < CONFIG_PDM_TRACE_RING_LEN) {
+        ringCount++;
+    }
+    if (ringUnflushed < CONFIG_PDM_TRACE_RING_LEN) {
+        ringUnflushed++;
+    }
+#ifdef CONFIG_PDM_TRACE_FLASH
+    if (ringUnflushed == CONFIG_PDM_TRACE_RING_LEN) { // A full lap since the last flush.
+        PDMTrace_flush();
+    }
+#endif
+}
+
+uint16_t PDMTrace_snapshot(PDM_TraceRecord_t *records, const uint16_t maxRecords) {
+    uint16_t count = ringCount < maxRecords ? ringCount : maxRecords;
+    uint16_t start = (ringHead + CONFIG_PDM_TRACE_RING_LEN - count) % CONFIG_PDM_TRACE_RING_LEN;
+    for (uint16_t i = 0; i < count; i++) {
+        records[i] = ring[(start + i) % CONFIG_PDM_TRACE_RING_LEN];
+    }
+    return count;
+}
+
+void PDMTrace_flush() {
+#ifdef CONFIG_PDM_TRACE_FLASH
+    if (partition == NULL || ringUnflushed == 0) {
+        return;
+    }
+    const size_t offset = nextSector * SPI_FLASH_SEC_SIZE;
+    const PDM_TraceSectorHeader_t header = {
+        .magic = PDM_TRACE_MAGIC,
+        .sequence = nextSequence,
+        .count = ringUnflushed,
+        .recordSize = sizeof(PDM_TraceRecord_t),
+    };
+    // Only what previous flushes missed, so sectors never repeat a record.
+    // Oldest records first: [start, end of ring) then [0, head).
+    const uint16_t start = (ringHead + CONFIG_PDM_TRACE_RING_LEN - ringUnflushed) % CONFIG_PDM_TRACE_RING_LEN;
+    const uint16_t firstChunk = MIN(ringUnflushed, CONFIG_PDM_TRACE_RING_LEN - start);
+    esp_err_t err = esp_partition_erase_range(partition, offset, SPI_FLASH_SEC_SIZE);
+    if (err == ESP_OK) {
+        err = esp_partition_write(partition, offset + sizeof(header), &ring[start],
+                                  firstChunk * sizeof(PDM_TraceRecord_t));
+    }
+    if (err == ESP_OK && ringUnflushed > firstChunk) {
+        err = esp_partition_write(partition, offset + sizeof(header) + firstChunk * sizeof(PDM_TraceRecord_t),
+                                  &ring[0], (ringUnflushed - firstChunk) * sizeof(PDM_TraceRecord_t));
+    }
+    // Header goes last so a sector is only valid once its records are in place.
+    if (err == ESP_OK) {
+        err = esp_partition_write(partition, offset, &header, sizeof(header));
+    }
+    ringUnflushed = 0; // On errors too, or every new record would retry.
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to flush trace: %s", esp_err_to_name(err));
+        return;
+    }
+    nextSequence++;
+    nextSector = (nextSector + 1) % sectorCount;
+#endif
+}
\ No newline at end of file
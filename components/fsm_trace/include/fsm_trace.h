@@ -0,0 +1,107 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+/**
+ * @brief Compact recorder of FSM dispatches.
+ * 
+ * Records live in a RAM ring and are optionally flushed to the "trace"
+ * flash partition, one sector per lap of the ring.
+*/
+#ifndef __PDM_FSM_TRACE__
+#define __PDM_FSM_TRACE__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PDM_TRACE_MAGIC 0x544D4450 /**< "PDMT", marks a flushed sector.*/
+#define PDM_TRACE_PARTITION "trace"
+#define PDM_TRACE_FLAG_MATCHED 0x01 /**< The event matched an entry of the FSM table.*/
+#define PDM_TRACE_FLAG_REJECTED 0x02 /**< The event targeted an instance that doesn't exist.*/
+
+/**
+ * @brief One FSM dispatch. 16 bytes, little endian when flushed.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t timestampMs; /**< Time since boot.*/
+    uint8_t data;         /**< Event data, saturated to 8 bits.*/
+    uint8_t instance;     /**< FSM instance targeted, saturated to 8 bits.*/
+    uint16_t handlerUs;   /**< Time spent in the handler, saturated to 16 bits.*/
+    uint8_t source;       /**< Event source.*/
+    uint8_t prevState;    /**< State before the dispatch.*/
+    uint8_t nextState;    /**< State after the dispatch.*/
+    uint8_t flags;        /**< PDM_TRACE_FLAG_* bits.*/
+    uint32_t peer;        /**< Sender within the source, so replays reply to the same peer.*/
+} PDM_TraceRecord_t;
+
+/**
+ * @brief Header at the start of every flushed sector. 16 bytes.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;      /**< PDM_TRACE_MAGIC.*/
+    uint32_t sequence;   /**< Increases with every flush, to find the newest sector.*/
+    uint16_t count;      /**< Records following the header, oldest first.*/
+    uint16_t recordSize; /**< sizeof(PDM_TraceRecord_t), for decoders.*/
+    uint32_t reserved;
+} PDM_TraceSectorHeader_t;
+
+/**
+ * @brief Initializes the trace module.
+ * 
+ * When flushing is enabled, finds the newest flushed sector so that
+ * new flushes don't overwrite it.
+ */
+void PDMTrace_init();
+
+/**
+ * @brief Appends a record to the RAM ring, overwriting the oldest one
+ *        when full. Flushes to flash after a full lap of new records.
+ */
+void PDMTrace_record(const PDM_TraceRecord_t *record);
+
+/**
+ * @brief Copies the records in the ring, oldest first.
+ * 
+ * @param[out] records where to copy them.
+ * @param maxRecords room in records.
+ * 
+ * @return number of records copied.
+ */
+uint16_t PDMTrace_snapshot(PDM_TraceRecord_t *records, const uint16_t maxRecords);
+
+/**
+ * @brief Writes the records not flushed yet to the next sector of the
+ *        trace partition, so consecutive sectors never overlap.
+ * 
+ * @note Erases a flash sector, which blocks for tens of milliseconds.
+ */
+void PDMTrace_flush();
+
+#endif // __PDM_FSM_TRACE__
\ No newline at end of file
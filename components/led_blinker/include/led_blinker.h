@@ -39,6 +39,7 @@
 #define BLINK_GPIO GPIO_NUM_2
 #define PDM_SLOW_SPEED_MS 1000
 #define PDM_FAST_SPEED_MS 200
+#define PDM_BLINK_MAX_CHANNELS 8 /**< Max number of LEDs driven by the module.*/
 
 /**
  * @brief Speeds at which the led blinker can run.
@@ -64,6 +65,25 @@ void PDMBlink_Init(const PDM_BlinkSpeed_t blinkSpeed);
  */
 void PDMBlink_SpeedUpdate(const PDM_BlinkSpeed_t blinkSpeed);
 
+/**
+ * @brief Initializes a channel, driving another LED.
+ * 
+ * Channel 0 is BLINK_GPIO, as set up by PDMBlink_Init.
+ * 
+ * @param channel channel number, below PDM_BLINK_MAX_CHANNELS.
+ * @param gpio pin the LED is connected to.
+ * @param blinkSpeed initial speed.
+ */
+void PDMBlink_ChannelInit(const uint8_t channel, const gpio_num_t gpio, const PDM_BlinkSpeed_t blinkSpeed);
+
+/**
+ * @brief Updates the blinkSpeed of a channel on the go.
+ * 
+ * @param channel channel number.
+ * @param blinkSpeed new speed.
+ */
+void PDMBlink_ChannelSpeedUpdate(const uint8_t channel, const PDM_BlinkSpeed_t blinkSpeed);
+
 /**
  * @brief Task to be run in the main loop of an application
  *        to keep the module going. 
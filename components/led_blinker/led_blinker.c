@@ -41,40 +41,74 @@ static const TickType_t blinkSpeedTableTicks[] = {
     pdMS_TO_TICKS(PDM_FAST_SPEED_MS)
 };
 
-static PDM_BlinkSpeed_t currentBlinkSpeed;
-static TickType_t timeCount;
-static bool ledOn = true;
+/**
+ * @brief State of a blinking LED.
+ */
+typedef struct {
+    gpio_num_t gpio;
+    PDM_BlinkSpeed_t speed;
+    TickType_t timeCount;
+    bool ledOn;
+    bool isUsed;
+} PDM_BlinkChannel_t;
+
+static PDM_BlinkChannel_t channels[PDM_BLINK_MAX_CHANNELS];
 
 void PDMBlink_Init(const PDM_BlinkSpeed_t blinkSpeed) {
-  gpio_reset_pin(BLINK_GPIO);
-  gpio_set_direction(BLINK_GPIO, GPIO_MODE_OUTPUT);
-  gpio_set_level(BLINK_GPIO, 1);        
-  currentBlinkSpeed = blinkSpeed;
-  timeCount = xTaskGetTickCount();
+    PDMBlink_ChannelInit(0, BLINK_GPIO, blinkSpeed);
 }
 
 void PDMBlink_SpeedUpdate(const PDM_BlinkSpeed_t blinkSpeed) {
-    currentBlinkSpeed = blinkSpeed;
-    timeCount = xTaskGetTickCount();
-    if(currentBlinkSpeed == PDM_BLINK_ALWAYS_ON) {
-        ledOn = true;
-        gpio_set_level(BLINK_GPIO, 1);        
+    PDMBlink_ChannelSpeedUpdate(0, blinkSpeed);
+}
+
+void PDMBlink_ChannelInit(const uint8_t channel, const gpio_num_t gpio, const PDM_BlinkSpeed_t blinkSpeed) {
+  if(channel >= PDM_BLINK_MAX_CHANNELS) {
+      return;
+  }
+  PDM_BlinkChannel_t *c = &channels[channel];
+  gpio_reset_pin(gpio);
+  gpio_set_direction(gpio, GPIO_MODE_OUTPUT);
+  gpio_set_level(gpio, 1);        
+  c->gpio = gpio;
+  c->speed = blinkSpeed;
+  c->timeCount = xTaskGetTickCount();
+  c->ledOn = true;
+  c->isUsed = true;
+}
+
+void PDMBlink_ChannelSpeedUpdate(const uint8_t channel, const PDM_BlinkSpeed_t blinkSpeed) {
+    if(channel >= PDM_BLINK_MAX_CHANNELS || !channels[channel].isUsed) {
+        return;
+    }
+    PDM_BlinkChannel_t *c = &channels[channel];
+    c->speed = blinkSpeed;
+    c->timeCount = xTaskGetTickCount();
+    if(c->speed == PDM_BLINK_ALWAYS_ON) {
+        c->ledOn = true;
+        gpio_set_level(c->gpio, 1);        
     }
 }
 
 void PDMBlink_Task() {
     ESP_LOGI("BlinkTask", "Switch");
-    switch(currentBlinkSpeed) {
-    case PDM_BLINK_SPEED_SLOW ... PDM_BLINK_SPEED_FAST:
-        ESP_LOGI("BlinkTask", "Speed Running %d", currentBlinkSpeed);
-        if(xTaskGetTickCount() - timeCount > blinkSpeedTableTicks[currentBlinkSpeed]) {
-            ledOn = !ledOn;
-            gpio_set_level(BLINK_GPIO, ledOn);
-            timeCount = xTaskGetTickCount();
+    for(uint8_t i = 0; i < PDM_BLINK_MAX_CHANNELS; i++) {
+        PDM_BlinkChannel_t *c = &channels[i];
+        if(!c->isUsed) {
+            continue;
+        }
+        switch(c->speed) {
+        case PDM_BLINK_SPEED_SLOW ... PDM_BLINK_SPEED_FAST:
+            ESP_LOGI("BlinkTask", "Channel %d Speed Running %d", i, c->speed);
+            if(xTaskGetTickCount() - c->timeCount > blinkSpeedTableTicks[c->speed]) {
+                c->ledOn = !c->ledOn;
+                gpio_set_level(c->gpio, c->ledOn);
+                c->timeCount = xTaskGetTickCount();
+            }
+            break; 
+        default:
+            ESP_LOGI("BlinkTask", "Default");
+            break;
         }
-        break; 
-    default:
-        ESP_LOGI("BlinkTask", "Default");
-        break;
     }
 }
@@ -0,0 +1,100 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+/**
+ * @brief Streaming firmware updates.
+ * 
+ * Stream format:
+ *   | 'P' 'O' 'T' 'A' | compressed size (4 bytes LE) | image size (4 bytes LE) | zlib stream |
+ * 
+ * The stream is inflated with a fixed window and written straight into
+ * the inactive OTA slot, so the image is never held in RAM.
+*/
+#ifndef __PDM_OTA_UPDATE__
+#define __PDM_OTA_UPDATE__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define PDM_OTA_MAGIC "POTA"
+#define PDM_OTA_HEADER_LEN 12
+
+/**
+ * @brief State of an update after feeding it data.
+ */
+typedef enum {
+    PDM_OTA_IN_PROGRESS = 0, /**< Waiting for more data.*/
+    PDM_OTA_DONE,            /**< Image written, verified and set as boot partition.*/
+    PDM_OTA_FAILED,          /**< Update aborted. The running image is kept.*/
+} PDM_OtaStatus_t;
+
+/**
+ * @brief Prepares the inactive slot and the decompressor.
+ * 
+ * @return true if an update can start.
+ */
+bool PDMOta_begin();
+
+/**
+ * @brief Feeds a chunk of the stream.
+ * 
+ * @param data chunk, of any size.
+ * @param len length of data.
+ * 
+ * @return status of the update after the chunk.
+ */
+PDM_OtaStatus_t PDMOta_write(const uint8_t *data, const size_t len);
+
+/**
+ * @brief Aborts an update in progress, if any.
+ */
+void PDMOta_abort();
+
+/**
+ * @brief Gets how much of the stream, as announced by its header, the
+ *        update wasn't fed yet. Lets the caller skip it after a failure.
+ * 
+ * @param[out] left bytes of the stream still to come.
+ * 
+ * @return false if no valid header was read, so the length is unknown.
+ */
+bool PDMOta_streamLeft(uint32_t *left);
+
+/**
+ * @brief Marks the running image as valid if it was pending verification.
+ * 
+ * To be called once the application proved it works (e.g. it reached
+ * the server). Until then a reset rolls back to the previous image.
+ */
+void PDMOta_confirmImage();
+
+#endif // __PDM_OTA_UPDATE__
\ No newline at end of file
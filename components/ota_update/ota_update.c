@@ -0,0 +1,220 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "ota_update.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp32/rom/miniz.h"
+
+#define PDM_OTA_DICT_SIZE (1 << CONFIG_PDM_OTA_WINDOW_BITS)
+
+#ifndef OTA_WITH_SEQUENTIAL_WRITES
+#define OTA_WITH_SEQUENTIAL_WRITES OTA_SIZE_UNKNOWN
+#endif
+
+static const char *TAG = "ota_update";
+
+/** Decompressor **********************************/
+/** Only allocated while an update is in progress. */
+typedef struct {
+    tinfl_decompressor inflator;
+    uint8_t dict[PDM_OTA_DICT_SIZE]; /**< Inflate window, flushed to flash as it fills.*/
+} PDM_OtaInflate_t;
+
+static PDM_OtaInflate_t *inflate = NULL;
+static size_t dictOffset = 0;
+
+/** Update State **********************************/
+static const esp_partition_t *target = NULL;
+static esp_ota_handle_t otaHandle;
+static uint8_t header[PDM_OTA_HEADER_LEN];
+static size_t headerLen = 0;
+static uint32_t compressedSize = 0;
+static uint32_t compressedLeft = 0;
+static bool isHeaderValid = false; /**< compressedSize and compressedLeft come from the stream.*/
+static uint32_t imageSize = 0;
+static uint32_t written = 0;
+static int64_t startUs = 0;
+
+static inline uint32_t PDMOta_le32_(const uint8_t *bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static void PDMOta_release_() {
+    free(inflate);
+    inflate = NULL;
+}
+
+static PDM_OtaStatus_t PDMOta_fail_(const char *reason) {
+    ESP_LOGE(TAG, "Update failed: %s", reason);
+    esp_ota_abort(otaHandle);
+    PDMOta_release_();
+    return PDM_OTA_FAILED;
+}
+
+static PDM_OtaStatus_t PDMOta_finish_() {
+    if (written != imageSize) {
+        return PDMOta_fail_("image size mismatch");
+    }
+    // Checks the image header, checksum and appended SHA-256.
+    esp_err_t err = esp_ota_end(otaHandle);
+    PDMOta_release_();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Image verification failed: %s", esp_err_to_name(err));
+        return PDM_OTA_FAILED;
+    }
+    err = esp_ota_set_boot_partition(target);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to set boot partition: %s", esp_err_to_name(err));
+        return PDM_OTA_FAILED;
+    }
+    const int64_t elapsedMs = MAX((esp_timer_get_time() - startUs) / 1000, 1);
+    ESP_LOGI(TAG, "Wrote %u bytes (%u compressed) to %s in %lld ms, %lld KB/s, min free heap %u",
+             written, compressedSize, target->label, elapsedMs, written / elapsedMs,
+             esp_get_minimum_free_heap_size());
+    return PDM_OTA_DONE;
+}
+
+static PDM_OtaStatus_t PDMOta_inflate_(const uint8_t *data, size_t len, const bool hasMoreInput) {
+    const mz_uint32 flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (hasMoreInput ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+    for (;;) {
+        size_t inBytes = len;
+        size_t outBytes = PDM_OTA_DICT_SIZE - dictOffset;
+        tinfl_status status = tinfl_decompress(&inflate->inflator, data, &inBytes, inflate->dict,
+                                               inflate->dict + dictOffset, &outBytes, flags);
+        data += inBytes;
+        len -= inBytes;
+        if (outBytes > 0) {
+            if (written + outBytes > imageSize) {
+                return PDMOta_fail_("image larger than announced");
+            }
+            if (esp_ota_write(otaHandle, inflate->dict + dictOffset, outBytes) != ESP_OK) {
+                return PDMOta_fail_("flash write error");
+            }
+            written += outBytes;
+            dictOffset = (dictOffset + outBytes) & (PDM_OTA_DICT_SIZE - 1);
+        }
+        if (status < TINFL_STATUS_DONE) {
+            return PDMOta_fail_("corrupt stream or window too large");
+        }
+        if (status == TINFL_STATUS_DONE) {
+            return PDMOta_finish_();
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) {
+            return hasMoreInput ? PDM_OTA_IN_PROGRESS : PDMOta_fail_("truncated stream");
+        }
+    }
+}
+
+bool PDMOta_begin() {
+    PDMOta_abort();
+    target = esp_ota_get_next_update_partition(NULL);
+    if (target == NULL) {
+        ESP_LOGE(TAG, "No OTA slot available");
+        return false;
+    }
+    inflate = malloc(sizeof(PDM_OtaInflate_t));
+    if (inflate == NULL) {
+        ESP_LOGE(TAG, "Unable to allocate %u bytes for the decompressor", sizeof(PDM_OtaInflate_t));
+        return false;
+    }
+    // Sectors are erased as they are written, so this doesn't block for the whole slot.
+    esp_err_t err = esp_ota_begin(target, OTA_WITH_SEQUENTIAL_WRITES, &otaHandle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to start update: %s", esp_err_to_name(err));
+        PDMOta_release_();
+        return false;
+    }
+    tinfl_init(&inflate->inflator);
+    dictOffset = 0;
+    headerLen = 0;
+    isHeaderValid = false;
+    written = 0;
+    startUs = esp_timer_get_time();
+    ESP_LOGI(TAG, "Updating %s, decompressor uses %u bytes", target->label, sizeof(PDM_OtaInflate_t));
+    return true;
+}
+
+PDM_OtaStatus_t PDMOta_write(const uint8_t *data, const size_t len) {
+    if (inflate == NULL) {
+        return PDM_OTA_FAILED;
+    }
+    size_t left = len;
+    if (headerLen < PDM_OTA_HEADER_LEN) {
+        const size_t take = MIN(left, PDM_OTA_HEADER_LEN - headerLen);
+        memcpy(header + headerLen, data, take);
+        headerLen += take;
+        data += take;
+        left -= take;
+        if (headerLen < PDM_OTA_HEADER_LEN) {
+            return PDM_OTA_IN_PROGRESS;
+        }
+        if (memcmp(header, PDM_OTA_MAGIC, 4) != 0) {
+            return PDMOta_fail_("bad header");
+        }
+        compressedSize = compressedLeft = PDMOta_le32_(header + 4);
+        imageSize = PDMOta_le32_(header + 8);
+        isHeaderValid = true;
+        if (imageSize == 0 || imageSize > target->size) {
+            return PDMOta_fail_("image doesn't fit the slot");
+        }
+    }
+    const size_t chunk = MIN(left, compressedLeft);
+    compressedLeft -= chunk;
+    return PDMOta_inflate_(data, chunk, compressedLeft > 0);
+}
+
+void PDMOta_abort() {
+    if (inflate != NULL) {
+        PDMOta_fail_("aborted");
+    }
+}
+
+bool PDMOta_streamLeft(uint32_t *left) {
+    *left = compressedLeft;
+    return isHeaderValid;
+}
+
+void PDMOta_confirmImage() {
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        esp_ota_mark_app_valid_cancel_rollback();
+        ESP_LOGI(TAG, "Image in %s marked as valid", running->label);
+    }
+}
\ No newline at end of file
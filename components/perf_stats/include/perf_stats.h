@@ -0,0 +1,75 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+/**
+ * @brief Performance counters of the main loop.
+ * 
+ * Every measurement window the module logs one line:
+ * 
+ *   PERF {"window_ms":..,"passes":..,"busy_passes":..,"events":..,
+ *         "loop_us_p50":..,"loop_us_p99":..,"loop_us_max":..,
+ *         "duty_permille":..,"stack_free":..,"heap_free":..,"heap_min":..}
+ * 
+ * The loop wakes up at a fixed period, so passes only gives the scale:
+ * busy_passes counts the passes that processed at least one event, and
+ * duty_permille the share of the window spent inside passes. Loop time
+ * percentiles are bucket upper bounds (powers of two), so they are only
+ * meant to be compared against each other.
+*/
+#ifndef __PDM_PERF_STATS__
+#define __PDM_PERF_STATS__
+
+#include <stdint.h>
+
+#define PDM_PERF_BUCKETS 24 /**< Loop time histogram buckets, log2 of microseconds.*/
+
+/**
+ * @brief Initializes the module and starts the first window.
+ */
+void PDMPerf_init();
+
+/**
+ * @brief Marks the start of a pass of the main loop.
+ */
+void PDMPerf_loopBegin();
+
+/**
+ * @brief Marks the end of a pass of the main loop. Logs the report
+ *        when the window is over.
+ */
+void PDMPerf_loopEnd();
+
+/**
+ * @brief Adds events processed in the current pass.
+ */
+void PDMPerf_addEvents(const uint32_t count);
+
+#endif // __PDM_PERF_STATS__
\ No newline at end of file
@@ -0,0 +1,127 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "perf_stats.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "perf";
+
+static int64_t windowStartUs = 0;
+static int64_t loopStartUs = 0;
+static uint32_t passes = 0;
+static uint32_t busyPasses = 0;   /**< Passes that processed at least one event.*/
+static uint32_t events = 0;
+static uint32_t passEvents = 0;   /**< Events of the pass in progress.*/
+static uint64_t loopUsTotal = 0;  /**< Time spent inside passes.*/
+static uint32_t loopMaxUs = 0;
+static uint32_t histogram[PDM_PERF_BUCKETS]; /**< Bucket i counts loops below 2^i us.*/
+
+/** Helpers ***************************************/
+static uint8_t PDMPerf_bucket_(uint32_t us) {
+    uint8_t bucket = 0;
+    while (us > 0 && bucket < PDM_PERF_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static uint32_t PDMPerf_percentile_(const uint32_t permille) {
+    const uint32_t target = ((uint64_t)passes * permille + 999) / 1000;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < PDM_PERF_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen >= target) {
+            return 1UL << i;
+        }
+    }
+    return 1UL << (PDM_PERF_BUCKETS - 1);
+}
+
+static void PDMPerf_report_(const int64_t nowUs) {
+    const int64_t windowUs = nowUs - windowStartUs;
+    ESP_LOGI(TAG, "PERF {\"window_ms\":%u,\"passes\":%u,\"busy_passes\":%u,\"events\":%u,"
+             "\"loop_us_p50\":%u,\"loop_us_p99\":%u,\"loop_us_max\":%u,\"duty_permille\":%u,"
+             "\"stack_free\":%u,\"heap_free\":%u,\"heap_min\":%u}",
+             (uint32_t)(windowUs / 1000), passes, busyPasses, events,
+             PDMPerf_percentile_(500), PDMPerf_percentile_(990), loopMaxUs,
+             (uint32_t)(windowUs > 0 ? loopUsTotal * 1000 / windowUs : 0),
+             uxTaskGetStackHighWaterMark(NULL), esp_get_free_heap_size(),
+             esp_get_minimum_free_heap_size());
+}
+
+static void PDMPerf_startWindow_(const int64_t nowUs) {
+    windowStartUs = nowUs;
+    passes = 0;
+    busyPasses = 0;
+    events = 0;
+    loopUsTotal = 0;
+    loopMaxUs = 0;
+    memset(histogram, 0, sizeof(histogram));
+}
+
+/** Public Methods ********************************/
+void PDMPerf_init() {
+    PDMPerf_startWindow_(esp_timer_get_time());
+}
+
+void PDMPerf_loopBegin() {
+    loopStartUs = esp_timer_get_time();
+}
+
+void PDMPerf_loopEnd() {
+    const int64_t nowUs = esp_timer_get_time();
+    const uint32_t loopUs = nowUs - loopStartUs;
+    passes++;
+    busyPasses += passEvents > 0;
+    passEvents = 0;
+    loopUsTotal += loopUs;
+    histogram[PDMPerf_bucket_(loopUs)]++;
+    if (loopUs > loopMaxUs) {
+        loopMaxUs = loopUs;
+    }
+    if (nowUs - windowStartUs >= (int64_t)CONFIG_PDM_PERF_REPORT_PERIOD_S * 1000000) {
+        PDMPerf_report_(nowUs);
+        PDMPerf_startWindow_(nowUs);
+    }
+}
+
+void PDMPerf_addEvents(const uint32_t count) {
+    events += count;
+    passEvents += count;
+}
\ No newline at end of file
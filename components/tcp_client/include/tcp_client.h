@@ -40,38 +40,73 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "transport.h"
 
-#define HOST_IP_ADDR "192.168.0.14"
-#define PORT 3333
+#define PDM_NET_MAX_ENDPOINTS 4 /**< Max number of servers the client can fail over across.*/
+#define PDM_NET_MAX_HOST_LEN 64  /**< Max length of a server address or hostname.*/
+#define PDM_NET_NVS_NAMESPACE "pdm_net" /**< NVS namespace holding the endpoint overrides.*/
+#define PDM_NET_IFKEY "WIFI_STA_DEF"     /**< Interface link-local IPv6 servers are reached through.*/
+#define PDM_NET_STREAM_READS_PER_POLL 32 /**< Max socket reads per poll while streaming.*/
+#define PDM_NET_STREAM_TIMEOUT_MS 10000  /**< A stream is aborted after this long without data.*/
+#define PDM_NET_RECONNECT_INTERVAL_MS 2000 /**< Min time between rounds of attempts to reach a lost server.*/
+#define PDM_NET_CONNECT_TIMEOUT_MS 3000    /**< A server that hasn't accepted the connection by then is skipped.*/
+#define PDM_NET_TLS_HANDSHAKE_TIMEOUT_MS 5000 /**< Max time the main loop waits for a TLS handshake.*/
 
-/** Syntatic sugar  for functions receiving an int and returning void.*/
-typedef void(*IntConsumer_t)(const uint32_t value);
+/**
+ * @brief Consumes raw bytes from the server.
+ * 
+ * Called with data == NULL and len == 0 if the stream stalled.
+ * 
+ * @return false once it doesn't want any more bytes.
+ */
+typedef bool (*PDM_StreamSink_t)(const uint8_t *data, const size_t len);
 
 /**
- * @brief Initializes the PDM Network module.
+ * @brief Gets the transport carrying the TCP server connection.
+ * 
+ * Servers are taken from Kconfig and, if enabled, overridden from NVS.
+ * The last server that accepted a connection is tried first; if it fails
+ * the remaining servers are tried in order. Once the transport is up,
+ * reconnecting never blocks the poll: a connect is started and checked on
+ * later polls, one server at a time. Commands are received as
+ * parsed by PDMTransport_parseCommand, several per segment if the server
+ * pipelines them. Each value sent is a single ASCII digit.
  * 
- * @param onDataReceived function to be called when a message from the 
- *                        server arrives.
+ * @note NVS must be initialized before initializing the transport.
+ * @note Polling was only tested with a refresh rate of .5 seconds. 
+ *       There are no guarantees that it will or will not work with
+ *       higher or lower rates.
+ */
+PDM_Transport_t *PDMNetwork_transport();
+
+/**
+ * @brief Diverts the bytes coming from the server to a sink, instead of
+ *        parsing them as commands, until the sink returns false.
  * 
- * @return true if initalization succeeded.
- * @return false if there was an error when initializing the module.
+ * @param sink consumer of the raw bytes.
  */
-bool PDMNetwork_init(IntConsumer_t onDataReceived);
+void PDMNetwork_setStreamSink(PDM_StreamSink_t sink);
 
 /**
- * @brief Sends a message to the server.
+ * @brief Drops what is left of a stream its sink gave up on, so it is
+ *        never parsed as commands.
  * 
- * @param message to be sent.
+ * Called by the sink, before returning false, when it stops short of
+ * the end of the stream.
+ * 
+ * @param len bytes of the stream still to come after the chunk being
+ *        consumed, or SIZE_MAX if unknown: the connection is then closed
+ *        (once replies already sent are written) and reestablished.
  */
-void PDMNetwork_send(const uint32_t message);
+void PDMNetwork_discardStream(const size_t len);
 
 /**
- * @brief Task to be run in the main loop of an application
- *        to keep the module going. 
- * @note  This was only tested with a refresh rate of .5 seconds. 
- *        There are no guarantees that it will or will not work with
- *        higher or lower rates.
+ * @brief Closes the connection gracefully: TLS close notify, if any,
+ *        then a FIN behind whatever was already written.
+ * 
+ * Meant for shutting down (e.g. before a restart): the transport
+ * reconnects on its next poll.
  */
-void PDMNetwork_task();
+void PDMNetwork_close();
 
 #endif // _TCP_CLIENT_
\ No newline at end of file
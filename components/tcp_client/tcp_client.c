@@ -33,6 +33,8 @@
 #include "tcp_client.h"
 
 #include <string.h>
+#include <stdint.h>
+#include <ctype.h>
 #include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -42,88 +44,697 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "nvs.h"
 #include "lwip/err.h"
 #include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#ifdef CONFIG_PDM_NET_TLS
+#include "esp_timer.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/platform.h"
+#include "esp_heap_caps.h"
+#endif
+
+#if defined(CONFIG_EXAMPLE_IPV4)
+#define PDM_NET_DEFAULT_HOST CONFIG_EXAMPLE_IPV4_ADDR
+#elif defined(CONFIG_EXAMPLE_IPV6)
+#define PDM_NET_DEFAULT_HOST CONFIG_EXAMPLE_IPV6_ADDR
+#else
+#define PDM_NET_DEFAULT_HOST ""
+#endif
 
 static const char *TAG = "tcp_client";
-static IntConsumer_t onDataReceivedCallback;
 static uint8_t reconnect = 0;
 
+static bool PDMNetwork_init_(PDM_Transport_t *transport);
+static void PDMNetwork_poll_(PDM_Transport_t *transport);
+static bool PDMNetwork_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value);
+
+static const PDM_TransportOps_t networkOps = {
+    .init = PDMNetwork_init_,
+    .poll = PDMNetwork_poll_,
+    .send = PDMNetwork_send_,
+};
+
+static PDM_Transport_t networkTransport = {
+    .name = "tcp",
+    .ops = &networkOps,
+};
+
 
 /** Internal Connection Constants. ****************/
-static const char host_ip[] = HOST_IP_ADDR;
-static const int addr_family = AF_INET;
 static const int ip_protocol = IPPROTO_IP;
 
 // static char tx_buffer[128];
-static char rx_buffer[128];
-static struct sockaddr_in dest_addr;
+static char rx_buffer[512];
+static int rxLen = 0;    /**< Bytes in rx_buffer.*/
+static int rxParsed = 0; /**< Bytes of rx_buffer already parsed. Parsing stops while the RX queue is full.*/
+static PDM_CommandParser_t parser;
 
-static int sock;
+static int sock = -1;
+static TickType_t lastReconnect; /**< End of the last round of connection attempts that failed.*/
 
-/** Flow Variables ********************************/
-static char dataToSend[] = "0";
-static bool isDataToSendReady = false;
+/** Endpoint Selection ****************************/
+typedef struct {
+    char host[PDM_NET_MAX_HOST_LEN]; /**< IPv4/IPv6 address or hostname.*/
+} PDM_Endpoint_t;
 
-void static PDMNetwork_reinit() {
-    ESP_LOGE(TAG, "Shutting down socket and restarting...");
-    shutdown(sock, 0);
-    close(sock);
-    PDMNetwork_init(onDataReceivedCallback);
+static PDM_Endpoint_t endpoints[PDM_NET_MAX_ENDPOINTS];
+static uint8_t endpointCount = 0;
+static uint8_t currentEndpoint = 0;
+static uint16_t port = CONFIG_EXAMPLE_PORT;
+static bool areEndpointsLoaded = false;
+
+/** Resolved address of the last server that accepted us, so reconnects skip DNS. */
+static struct sockaddr_storage cachedAddr;
+static socklen_t cachedAddrLen = 0;
+
+/** Connection Attempts ***************************/
+/** Servers are tried one per poll, and a connect is never waited for, so the main loop keeps running. */
+typedef enum {
+    PDM_NET_ATTEMPT_PENDING,
+    PDM_NET_ATTEMPT_DONE,
+    PDM_NET_ATTEMPT_FAILED,
+} PDM_NetAttempt_t;
+
+static bool isConnecting = false;  /**< sock is connecting to attemptAddr.*/
+static TickType_t connectStarted;
+static struct sockaddr_storage attemptAddr;
+static socklen_t attemptAddrLen;
+static bool isCachedAttempt;       /**< attemptAddr was taken from cachedAddr.*/
+static bool isRoundActive = false; /**< Servers of the current round are still to be tried.*/
+static uint8_t roundFirst;         /**< currentEndpoint when the round started.*/
+static uint8_t roundBase;          /**< Offset 1 of the round is the server after this one.*/
+static uint8_t roundNext;          /**< Offset of the next server to try, 0 being the cached address.*/
+
+/** Stream Mode ***********************************/
+static PDM_StreamSink_t streamSink = NULL;
+static TickType_t lastStreamData;
+static size_t discardLeft = 0; /**< Stream bytes to drop after the sink gave up. SIZE_MAX: close instead.*/
+
+#ifdef CONFIG_PDM_NET_TLS
+/** TLS Context ***********************************/
+/** Allocated once in PDMNetwork_tlsSetup_ and reused across reconnects. */
+extern const uint8_t caCertPemStart[] asm("_binary_ca_cert_pem_start");
+extern const uint8_t caCertPemEnd[]   asm("_binary_ca_cert_pem_end");
+
+static mbedtls_ssl_context ssl;
+static mbedtls_ssl_config sslConf;
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context ctrDrbg;
+static mbedtls_x509_crt caCert;
+static mbedtls_net_context sslNet;
+static bool isTlsReady = false;
+#ifdef CONFIG_PDM_NET_TLS_SESSION_RESUMPTION
+static mbedtls_ssl_session savedSession;
+static bool hasSavedSession = false;
+#endif
+/** Lowest free heap seen by an mbedTLS allocation since the handshake started.*/
+static size_t tlsHeapLow = SIZE_MAX;
+#endif
+
+/** Endpoint Helpers ******************************/
+static void PDMNetwork_addEndpoints_(const char *list) {
+    const char *cursor = list;
+    while (*cursor != '\0' && endpointCount < PDM_NET_MAX_ENDPOINTS) {
+        while (*cursor == ',' || isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+        size_t len = strcspn(cursor, ",");
+        size_t end = len;
+        while (end > 0 && isspace((unsigned char)cursor[end - 1])) {
+            end--;
+        }
+        if (end > 0 && end < PDM_NET_MAX_HOST_LEN) {
+            memcpy(endpoints[endpointCount].host, cursor, end);
+            endpoints[endpointCount].host[end] = '\0';
+            endpointCount++;
+        } else if (end > 0) {
+            ESP_LOGE(TAG, "Ignoring server entry longer than %d chars", PDM_NET_MAX_HOST_LEN - 1);
+        }
+        cursor += len;
+    }
+}
+
+static void PDMNetwork_loadEndpoints_() {
+    endpointCount = 0;
+    PDMNetwork_addEndpoints_(PDM_NET_DEFAULT_HOST);
+    PDMNetwork_addEndpoints_(CONFIG_PDM_NET_FALLBACK_HOSTS);
+
+    uint8_t lastGood = UINT8_MAX;
+    nvs_handle_t nvs;
+    if (nvs_open(PDM_NET_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+#ifdef CONFIG_PDM_NET_NVS_OVERRIDE
+        char servers[PDM_NET_MAX_ENDPOINTS * PDM_NET_MAX_HOST_LEN];
+        size_t serversLen = sizeof(servers);
+        if (nvs_get_str(nvs, "servers", servers, &serversLen) == ESP_OK) {
+            endpointCount = 0;
+            PDMNetwork_addEndpoints_(servers);
+        }
+        nvs_get_u16(nvs, "port", &port);
+#endif
+        nvs_get_u8(nvs, "last", &lastGood);
+        nvs_close(nvs);
+    }
+
+    if (endpointCount == 0) {
+        ESP_LOGE(TAG, "No servers configured");
+        return;
+    }
+    // Resume from the last good server, or spread boards across the list.
+    currentEndpoint = lastGood < endpointCount ? lastGood : esp_random() % endpointCount;
+    areEndpointsLoaded = true;
+}
+
+static void PDMNetwork_saveLastGood_(const uint8_t index) {
+    nvs_handle_t nvs;
+    uint8_t stored = UINT8_MAX;
+    if (nvs_open(PDM_NET_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    nvs_get_u8(nvs, "last", &stored);
+    if (stored != index) { // Only touch flash when the server actually changed.
+        nvs_set_u8(nvs, "last", index);
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+static bool PDMNetwork_resolve_(const char *host, struct sockaddr_storage *addr, socklen_t *addrLen) {
+    const struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    char portStr[6];
+    snprintf(portStr, sizeof(portStr), "%u", port);
+    int err = getaddrinfo(host, portStr, &hints, &res);
+    if (err != 0 || res == NULL) {
+        ESP_LOGE(TAG, "Unable to resolve %s: error %d", host, err);
+        return false;
+    }
+    memcpy(addr, res->ai_addr, res->ai_addrlen);
+    *addrLen = res->ai_addrlen;
+    freeaddrinfo(res);
+    if (addr->ss_family == AF_INET6) {
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)addr;
+        const bool isLinkLocal = addr6->sin6_addr.s6_addr[0] == 0xfe && (addr6->sin6_addr.s6_addr[1] & 0xc0) == 0x80;
+        if (isLinkLocal && addr6->sin6_scope_id == 0) {
+            // Link-local addresses are only reachable through the interface they belong to.
+            addr6->sin6_scope_id = esp_netif_get_netif_impl_index(esp_netif_get_handle_from_ifkey(PDM_NET_IFKEY));
+        }
+    }
+    return true;
+}
+
+#ifdef CONFIG_PDM_NET_TLS
+/** TLS Helpers ***********************************/
+#ifdef MBEDTLS_PLATFORM_MEMORY
+#ifdef CONFIG_MBEDTLS_INTERNAL_MEM_ALLOC
+#define PDM_NET_TLS_HEAP_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#else
+#define PDM_NET_TLS_HEAP_CAPS MALLOC_CAP_DEFAULT
+#endif
+
+/**
+ * @brief Allocates for mbedTLS like the IDF default does, and samples the free heap right
+ * after each allocation so the handshake log can report its own peak, not the one since boot.
+ */
+static void *PDMNetwork_tlsCalloc_(size_t count, size_t size) {
+    void *ptr = heap_caps_calloc(count, size, PDM_NET_TLS_HEAP_CAPS);
+    const size_t freeHeap = esp_get_free_heap_size();
+    if (freeHeap < tlsHeapLow) {
+        tlsHeapLow = freeHeap;
+    }
+    return ptr;
+}
+
+static void PDMNetwork_tlsFree_(void *ptr) {
+    heap_caps_free(ptr);
+}
+#endif
+
+static bool PDMNetwork_tlsSetup_() {
+#ifdef MBEDTLS_PLATFORM_MEMORY
+    mbedtls_platform_set_calloc_free(PDMNetwork_tlsCalloc_, PDMNetwork_tlsFree_);
+#endif
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_config_init(&sslConf);
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctrDrbg);
+    mbedtls_x509_crt_init(&caCert);
+    mbedtls_net_init(&sslNet);
+#ifdef CONFIG_PDM_NET_TLS_SESSION_RESUMPTION
+    mbedtls_ssl_session_init(&savedSession);
+#endif
+
+    int err = mbedtls_ctr_drbg_seed(&ctrDrbg, mbedtls_entropy_func, &entropy, NULL, 0);
+    if (err != 0) {
+        ESP_LOGE(TAG, "Unable to seed TLS RNG: -0x%x", -err);
+        return false;
+    }
+    err = mbedtls_x509_crt_parse(&caCert, caCertPemStart, caCertPemEnd - caCertPemStart);
+    if (err != 0) {
+        ESP_LOGE(TAG, "Unable to parse CA certificate: -0x%x", -err);
+        return false;
+    }
+    err = mbedtls_ssl_config_defaults(&sslConf, MBEDTLS_SSL_IS_CLIENT,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (err != 0) {
+        ESP_LOGE(TAG, "Unable to set TLS defaults: -0x%x", -err);
+        return false;
+    }
+    mbedtls_ssl_conf_authmode(&sslConf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&sslConf, &caCert, NULL);
+    mbedtls_ssl_conf_rng(&sslConf, mbedtls_ctr_drbg_random, &ctrDrbg);
+#ifdef CONFIG_PDM_NET_TLS_SESSION_RESUMPTION
+    mbedtls_ssl_conf_session_tickets(&sslConf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+#ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+    mbedtls_ssl_conf_max_frag_len(&sslConf, CONFIG_PDM_NET_TLS_MAX_FRAG_LEN_CODE);
+#endif
+    // Record buffers are allocated here, once.
+    err = mbedtls_ssl_setup(&ssl, &sslConf);
+    if (err != 0) {
+        ESP_LOGE(TAG, "Unable to set up TLS context: -0x%x", -err);
+        return false;
+    }
+    isTlsReady = true;
+    return true;
+}
+
+/** Waits up to timeoutUs for the socket to take a read, or a write, from the handshake. */
+static bool PDMNetwork_tlsWait_(const bool isRead, const int64_t timeoutUs) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    struct timeval timeout = {
+        .tv_sec = timeoutUs / 1000000,
+        .tv_usec = timeoutUs % 1000000,
+    };
+    return select(sock + 1, isRead ? &fds : NULL, isRead ? NULL : &fds, NULL, &timeout) > 0;
+}
+
+/**
+ * @brief Runs the handshake on the non-blocking socket, waiting for it at most
+ * PDM_NET_TLS_HANDSHAKE_TIMEOUT_MS in total, so a server that stops answering
+ * halfway can't hold the main loop.
+ */
+static bool PDMNetwork_tlsHandshake_() {
+    const int64_t start = esp_timer_get_time();
+    const size_t heapBefore = esp_get_free_heap_size();
+    bool offeredSession = false;
+    tlsHeapLow = heapBefore;
+
+    mbedtls_ssl_session_reset(&ssl);
+    mbedtls_ssl_set_hostname(&ssl, endpoints[currentEndpoint].host);
+#ifdef CONFIG_PDM_NET_TLS_SESSION_RESUMPTION
+    if (hasSavedSession) {
+        offeredSession = mbedtls_ssl_set_session(&ssl, &savedSession) == 0;
+    }
+#endif
+    sslNet.fd = sock;
+    mbedtls_ssl_set_bio(&ssl, &sslNet, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+    const int64_t deadline = start + PDM_NET_TLS_HANDSHAKE_TIMEOUT_MS * 1000LL;
+    int err;
+    while ((err = mbedtls_ssl_handshake(&ssl)) != 0) {
+        const bool isWaiting = err == MBEDTLS_ERR_SSL_WANT_READ || err == MBEDTLS_ERR_SSL_WANT_WRITE;
+        const int64_t leftUs = deadline - esp_timer_get_time();
+        if (!isWaiting || leftUs <= 0 || !PDMNetwork_tlsWait_(err == MBEDTLS_ERR_SSL_WANT_READ, leftUs)) {
+            if (isWaiting) {
+                ESP_LOGE(TAG, "TLS handshake timed out after %d ms", PDM_NET_TLS_HANDSHAKE_TIMEOUT_MS);
+            } else {
+                ESP_LOGE(TAG, "TLS handshake failed: -0x%x", -err);
+            }
+#ifdef CONFIG_PDM_NET_TLS_SESSION_RESUMPTION
+            hasSavedSession = false; // Don't insist on a session the server may reject.
+#endif
+            return false;
+        }
+    }
+
+#ifdef CONFIG_PDM_NET_TLS_SESSION_RESUMPTION
+    mbedtls_ssl_session_free(&savedSession);
+    mbedtls_ssl_session_init(&savedSession);
+    hasSavedSession = mbedtls_ssl_get_session(&ssl, &savedSession) == 0;
+#endif
+    const size_t heapAfter = esp_get_free_heap_size();
+    const size_t heapLow = MIN(tlsHeapLow, heapAfter);
+    // The high-water mark covers the handshake we just ran on this task's stack.
+    ESP_LOGI(TAG, "TLS handshake done in %lld ms (session offered: %s), heap peak %u, kept %d, stack free %u",
+             (esp_timer_get_time() - start) / 1000, offeredSession ? "yes" : "no",
+             heapBefore - heapLow, (int)heapBefore - (int)heapAfter, uxTaskGetStackHighWaterMark(NULL));
+    return true;
+}
+#endif
+
+/** Socket I/O ************************************/
+static int PDMNetwork_write_(const char *data, const size_t len) {
+#ifdef CONFIG_PDM_NET_TLS
+    int written = mbedtls_ssl_write(&ssl, (const unsigned char *)data, len);
+    if (written == MBEDTLS_ERR_SSL_WANT_READ || written == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+    return written < 0 ? -1 : written;
+#else
+    return send(sock, data, len, 0);
+#endif
+}
+
+/** Returns the bytes read, 0 if there's nothing to read yet or -1 if the connection is gone. */
+static int PDMNetwork_read_(char *data, const size_t len) {
+#ifdef CONFIG_PDM_NET_TLS
+    int read = mbedtls_ssl_read(&ssl, (unsigned char *)data, len);
+    if (read == MBEDTLS_ERR_SSL_WANT_READ || read == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+    return read <= 0 ? -1 : read; // 0 or close notify: the server hung up.
+#else
+    int read = recv(sock, data, len, MSG_DONTWAIT);
+    if (read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    return read <= 0 ? -1 : read; // 0: the server hung up.
+#endif
 }
 
-bool PDMNetwork_init(IntConsumer_t onDataReceived) {
-    dest_addr.sin_addr.s_addr = inet_addr(host_ip);
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(PORT);
-    onDataReceivedCallback = onDataReceived;
-    sock =  socket(addr_family, SOCK_STREAM, ip_protocol);
+/**
+ * @brief Starts connecting, without waiting, to the address of the current attempt.
+ */
+static bool PDMNetwork_startConnect_() {
+    rxLen = rxParsed = 0;
+    memset(&parser, 0, sizeof(parser)); // Whatever was half received belongs to the old connection.
+    sock =  socket(attemptAddr.ss_family, SOCK_STREAM, ip_protocol);
     if (sock < 0) {
         ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
         return false;
     }
-    ESP_LOGI(TAG, "Socket created, connecting to %s:%d", host_ip, PORT);
-
-    int err = connect(sock, (struct sockaddr *)&dest_addr, sizeof(struct sockaddr_in6));
+    ESP_LOGI(TAG, "Socket created, connecting to %s:%d", endpoints[currentEndpoint].host, port);
 
     if (fcntl(sock, F_SETFL,  O_NONBLOCK) < 0) {
         ESP_LOGE(TAG, "Failed to set nonblocking error");
     }
-
-    if (err != 0) {
+    int err = connect(sock, (const struct sockaddr *)&attemptAddr, attemptAddrLen);
+    if (err != 0 && errno != EINPROGRESS) {
         ESP_LOGE(TAG, "Socket unable to connect: errno %d", errno);
+        close(sock);
+        sock = -1;
+        return false;
+    }
+    isConnecting = true;
+    connectStarted = xTaskGetTickCount();
+    return true;
+}
+
+/**
+ * @brief Checks on the connect started by PDMNetwork_startConnect_.
+ *
+ * @param wait Whether to wait up to PDM_NET_CONNECT_TIMEOUT_MS for it, or only look.
+ */
+static PDM_NetAttempt_t PDMNetwork_finishConnect_(const bool wait) {
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(sock, &writable);
+    struct timeval timeout = {
+        .tv_sec = wait ? PDM_NET_CONNECT_TIMEOUT_MS / 1000 : 0,
+        .tv_usec = wait ? (PDM_NET_CONNECT_TIMEOUT_MS % 1000) * 1000 : 0,
+    };
+    int ready = select(sock + 1, NULL, &writable, NULL, &timeout);
+    if (ready == 0 && !wait && xTaskGetTickCount() - connectStarted < pdMS_TO_TICKS(PDM_NET_CONNECT_TIMEOUT_MS)) {
+        return PDM_NET_ATTEMPT_PENDING;
+    }
+    int err = 0;
+    socklen_t errLen = sizeof(err);
+    bool isConnected = false;
+    if (ready == 0) {
+        ESP_LOGE(TAG, "Timed out connecting to %s", endpoints[currentEndpoint].host);
+    } else if (ready < 0 || getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &errLen) != 0 || err != 0) {
+        ESP_LOGE(TAG, "Socket unable to connect: errno %d", err != 0 ? err : errno);
+    } else {
+        isConnected = true;
+    }
+#ifdef CONFIG_PDM_NET_TLS
+    if (isConnected) {
+        isConnected = PDMNetwork_tlsHandshake_();
+    }
+#endif
+    isConnecting = false;
+    if (!isConnected) {
+        close(sock);
+        sock = -1;
+        return PDM_NET_ATTEMPT_FAILED;
+    }
+
+    // Replies are a byte each: they must not wait for the server's delayed ACK.
+    const int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return PDM_NET_ATTEMPT_DONE;
+}
+
+/** Tries the cached address first, if any, then every server of the list once. */
+static void PDMNetwork_startRound_() {
+    roundFirst = currentEndpoint;
+    // Offset 0 is the cached address. Its server is then left for last.
+    roundNext = cachedAddrLen > 0 ? 0 : 1;
+    roundBase = cachedAddrLen > 0 ? currentEndpoint : (currentEndpoint + endpointCount - 1) % endpointCount;
+    isRoundActive = true;
+}
+
+/**
+ * @brief Moves the connection attempt on by at most one server.
+ *
+ * A pending connect is checked first; if none is pending the next server
+ * of the round is resolved and a connect to it started.
+ *
+ * @param wait Whether to wait for the connect to complete, or only look.
+ * @return true once connected.
+ */
+static bool PDMNetwork_step_(const bool wait) {
+    if (!isConnecting) {
+        if (!isRoundActive) {
+            return false;
+        }
+        if (roundNext > endpointCount) {
+            // Next round starts from the following server.
+            currentEndpoint = (roundFirst + 1) % endpointCount;
+            isRoundActive = false;
+            lastReconnect = xTaskGetTickCount();
+            return false;
+        }
+        const uint8_t offset = roundNext++;
+        isCachedAttempt = offset == 0;
+        if (isCachedAttempt) {
+            memcpy(&attemptAddr, &cachedAddr, cachedAddrLen);
+            attemptAddrLen = cachedAddrLen;
+        } else {
+            const uint8_t candidate = (roundBase + offset) % endpointCount;
+            if (!PDMNetwork_resolve_(endpoints[candidate].host, &attemptAddr, &attemptAddrLen)) {
+                return false;
+            }
+            currentEndpoint = candidate;
+        }
+        if (!PDMNetwork_startConnect_()) {
+            return false;
+        }
+    }
+
+    switch (PDMNetwork_finishConnect_(wait)) {
+    case PDM_NET_ATTEMPT_PENDING:
+        return false;
+    case PDM_NET_ATTEMPT_FAILED:
+        if (isCachedAttempt) {
+            cachedAddrLen = 0; // Stale, fall back to resolving the list.
+        }
         return false;
+    case PDM_NET_ATTEMPT_DONE:
+        break;
+    }
+    isRoundActive = false;
+    if (isCachedAttempt) {
+        ESP_LOGI(TAG, "Successfully reconnected");
+        return true;
     }
+    memcpy(&cachedAddr, &attemptAddr, attemptAddrLen);
+    cachedAddrLen = attemptAddrLen;
+    PDMNetwork_saveLastGood_(currentEndpoint);
     ESP_LOGI(TAG, "Successfully connected");
     return true;
 }
 
-void PDMNetwork_send(const uint32_t message) {
-    dataToSend[0] =  message + 0x30;
-    isDataToSendReady = true;
+static void PDMNetwork_reinit() {
+    ESP_LOGE(TAG, "Shutting down socket and restarting...");
+    if (sock >= 0) {
+#ifdef CONFIG_PDM_NET_TLS
+        if (!isConnecting) {
+            mbedtls_ssl_close_notify(&ssl);
+        }
+#endif
+        shutdown(sock, 0);
+        close(sock);
+        sock = -1;
+    }
+    isConnecting = false;
+    // The first server is tried on the next poll, the others one per poll after it.
+    PDMNetwork_startRound_();
 }
 
-void PDMNetwork_task() {
-    ESP_LOGD(TAG, "Task Running");
+static bool PDMNetwork_init_(PDM_Transport_t *transport) {
+    if (!areEndpointsLoaded) {
+        PDMNetwork_loadEndpoints_();
+        if (!areEndpointsLoaded) {
+            return false;
+        }
+    }
+#ifdef CONFIG_PDM_NET_TLS
+    if (!isTlsReady && !PDMNetwork_tlsSetup_()) {
+        return false;
+    }
+#endif
 
-    if (isDataToSendReady) {
-        int err = send(sock, dataToSend, strlen(dataToSend), 0);
-        ESP_LOGD(TAG, "Message sent");
-        if (err < 0) {
-            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+    // Nothing else runs yet: wait each server out.
+    PDMNetwork_startRound_();
+    while (isRoundActive) {
+        if (PDMNetwork_step_(true)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool PDMNetwork_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value) {
+    if (sock < 0 || isConnecting) {
+        return true; // Disconnected, the server that asked is gone.
+    }
+    const char dataToSend = value + 0x30;
+    int err = PDMNetwork_write_(&dataToSend, sizeof(dataToSend));
+    if (err < 0) {
+        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+        PDMNetwork_reinit();
+        return false;
+    }
+    ESP_LOGD(TAG, "Message sent");
+    return err > 0;
+}
+
+static void PDMNetwork_pollStream_() {
+    if (discardLeft == SIZE_MAX) {
+        // Replies to the stream went out with the last poll: the end of the stream can't be told apart.
+        ESP_LOGE(TAG, "Abandoned a stream of unknown length, reconnecting");
+        discardLeft = 0;
+        PDMNetwork_close();
+        return;
+    }
+    for (uint8_t i = 0; i < PDM_NET_STREAM_READS_PER_POLL && (streamSink != NULL || discardLeft > 0); i++) {
+        // Discarding stops at the end of the stream: the commands after it are parsed as usual.
+        const size_t want = streamSink != NULL ? sizeof(rx_buffer) : MIN(sizeof(rx_buffer), discardLeft);
+        int len = PDMNetwork_read_(rx_buffer, want);
+        if (len < 0) {
+            ESP_LOGE(TAG, "Connection lost while streaming");
+            if (streamSink != NULL) {
+                streamSink(NULL, 0);
+            }
+            streamSink = NULL;
+            discardLeft = 0;
             PDMNetwork_reinit();
+            return;
         }
-        isDataToSendReady = false;
+        if (len == 0) {
+            break;
+        }
+        lastStreamData = xTaskGetTickCount();
+        if (streamSink == NULL) {
+            discardLeft -= len;
+        } else if (!streamSink((const uint8_t *)rx_buffer, len)) {
+            streamSink = NULL;
+        }
+        if (discardLeft == SIZE_MAX) {
+            return;
+        }
+    }
+    if ((streamSink != NULL || discardLeft > 0) &&
+        xTaskGetTickCount() - lastStreamData > pdMS_TO_TICKS(PDM_NET_STREAM_TIMEOUT_MS)) {
+        ESP_LOGE(TAG, "Stream stalled, aborting");
+        if (streamSink != NULL) {
+            streamSink(NULL, 0);
+        }
+        streamSink = NULL;
+        discardLeft = SIZE_MAX; // The rest may still come.
     }
+}
 
-    ESP_LOGD(TAG, "Attempting Reception");
-    int len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, MSG_DONTWAIT);
-    ESP_LOGD(TAG, "After Reception %d", len);
-    if (len > 0) {
+static void PDMNetwork_poll_(PDM_Transport_t *transport) {
+    if (streamSink != NULL || discardLeft > 0) {
+        PDMNetwork_pollStream_();
+        return;
+    }
+    if (sock < 0 || isConnecting) {
+        if (!isRoundActive && xTaskGetTickCount() - lastReconnect >= pdMS_TO_TICKS(PDM_NET_RECONNECT_INTERVAL_MS)) {
+            PDMNetwork_startRound_();
+        }
+        PDMNetwork_step_(false);
+        return;
+    }
+    if (rxParsed == rxLen) {
+        ESP_LOGD(TAG, "Attempting Reception");
+        int len = PDMNetwork_read_(rx_buffer, sizeof(rx_buffer));
+        ESP_LOGD(TAG, "After Reception %d", len);
+        if (len < 0) {
+            PDMNetwork_reinit();
+            return;
+        }
+        if (len == 0) {
+            return;
+        }
         reconnect = 0;
-        onDataReceivedCallback((uint32_t)(rx_buffer[0]-0x30));    
-        rx_buffer[len] = 0; // Null-terminate whatever we received and treat like a string
-        ESP_LOGI(TAG, "Received %d bytes from %s:", len, host_ip);
+        rxLen = len;
+        rxParsed = 0;
+        ESP_LOGI(TAG, "Received %d bytes from %s", len, endpoints[currentEndpoint].host);
+    }
+    // Every command of the segment, as far as the RX queue takes them. The rest waits in rx_buffer.
+    while (rxParsed < rxLen && PDMTransport_rxSpace(transport) > 0) {
+        uint32_t value;
+        if (PDMTransport_parseCommand(&parser, rx_buffer[rxParsed++], &value)) {
+            PDMTransport_notify(transport, 0, value);
+        }
+    }
+}
+
+PDM_Transport_t *PDMNetwork_transport() {
+    return &networkTransport;
+}
+
+void PDMNetwork_close() {
+    isRoundActive = false;
+    lastReconnect = xTaskGetTickCount();
+    if (sock < 0) {
         return;
     }
+#ifdef CONFIG_PDM_NET_TLS
+    if (!isConnecting) {
+        mbedtls_ssl_close_notify(&ssl);
+    }
+#endif
+    shutdown(sock, SHUT_WR); // The stack still sends what was queued before the FIN.
+    close(sock);
+    sock = -1;
+    isConnecting = false;
+}
+
+void PDMNetwork_setStreamSink(PDM_StreamSink_t sink) {
+    rxLen = rxParsed = 0; // The stream follows the command that asked for it, nothing else is parsed.
+    lastStreamData = xTaskGetTickCount();
+    streamSink = sink;
+    discardLeft = 0;
+}
+
+void PDMNetwork_discardStream(const size_t len) {
+    if (len > 0 && len != SIZE_MAX) {
+        ESP_LOGI(TAG, "Dropping the %u bytes left in the stream", len);
+    }
+    discardLeft = len;
 }
\ No newline at end of file
@@ -0,0 +1,225 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * @brief Channel-agnostic transport layer.
+ * 
+ * Each transport (TCP, BT Serial, ...) implements a small set of operations
+ * and owns an RX and a TX queue. Drivers push received values with
+ * PDMTransport_notify, the application pulls them with PDMTransport_receive
+ * and replies through PDMTransport_send using the id and peer the value
+ * came from.
+*/
+#ifndef __PDM_TRANSPORT__
+#define __PDM_TRANSPORT__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PDM_TRANSPORT_MAX 4        /**< Max number of transports that can be registered.*/
+#define PDM_TRANSPORT_QUEUE_LEN 8  /**< Slots per RX/TX queue. Must be a power of two.*/
+
+/** Received value carrying a command for a given FSM instance (0 is the default one).*/
+#define PDM_TRANSPORT_COMMAND(code, instance) (((uint32_t)(instance) << 8) | (uint8_t)(code))
+#define PDM_TRANSPORT_COMMAND_CODE(value) ((value) & 0xFF)    /**< Command of a received value.*/
+#define PDM_TRANSPORT_COMMAND_INSTANCE(value) ((value) >> 8)  /**< Target instance of a received value.*/
+
+#define PDM_TRANSPORT_INSTANCE_PREFIX '@'     /**< Starts "@<instance>:<command>" in a command stream.*/
+#define PDM_TRANSPORT_INSTANCE_SEPARATOR ':'  /**< Ends the instance of a command stream prefix.*/
+
+/** Id of a registered transport. The application picks them.*/
+typedef uint8_t PDM_TransportId_t;
+
+/**
+ * @brief A value and the peer it came from or goes to.
+ */
+typedef struct {
+    uint32_t value; /**< Payload.*/
+    uint32_t peer;  /**< Transport specific (e.g. BT connection handle). 0 if unused.*/
+} PDM_TransportMessage_t;
+
+/**
+ * @brief Single producer/single consumer queue of messages.
+ * 
+ * Each side publishes its index with a release store and reads the other's
+ * with an acquire load, so either side may run on another task or core.
+ */
+typedef struct {
+    PDM_TransportMessage_t items[PDM_TRANSPORT_QUEUE_LEN];
+    _Atomic uint8_t head; /**< Next slot to be written.*/
+    _Atomic uint8_t tail; /**< Next slot to be read.*/
+} PDM_TransportQueue_t;
+
+/**
+ * @brief State of a command stream parser. Zero it to start.
+ */
+typedef struct {
+    uint8_t step;      /**< Position within the current command.*/
+    uint32_t instance; /**< Instance named so far.*/
+} PDM_CommandParser_t;
+
+typedef struct PDM_Transport PDM_Transport_t;
+
+/**
+ * @brief Operations a transport implementation provides.
+ */
+typedef struct {
+    bool (*init)(PDM_Transport_t *transport); /**< Brings the channel up. Returns false on failure.*/
+    void (*poll)(PDM_Transport_t *transport); /**< Runs from the main loop. May be NULL.*/
+    bool (*send)(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value); /**< Writes a value to a peer.*/
+} PDM_TransportOps_t;
+
+/**
+ * @brief A transport instance.
+ */
+struct PDM_Transport {
+    const char *name;               /**< Name used for logging.*/
+    const PDM_TransportOps_t *ops;  /**< Implementation.*/
+    PDM_TransportId_t id;           /**< Assigned when registered.*/
+    PDM_TransportQueue_t rx;        /**< Messages received, waiting for the application.*/
+    PDM_TransportQueue_t tx;        /**< Messages waiting to be written to the channel.*/
+};
+
+/**
+ * @brief Appends a message to a queue. Producer side.
+ * 
+ * @return false if the queue was full.
+ */
+bool PDMTransport_queuePush(PDM_TransportQueue_t *queue, const uint32_t peer, const uint32_t value);
+
+/**
+ * @brief Copies the oldest message of a queue without removing it. Consumer side.
+ * 
+ * @return false if the queue was empty.
+ */
+bool PDMTransport_queuePeek(const PDM_TransportQueue_t *queue, PDM_TransportMessage_t *message);
+
+/**
+ * @brief Removes the oldest message of a queue, once peeked. Consumer side.
+ */
+void PDMTransport_queueDrop(PDM_TransportQueue_t *queue);
+
+/**
+ * @brief Parses a text stream of commands, one byte at a time.
+ * 
+ * A command is a single digit, for instance 0, or "@<instance>:<digit>"
+ * for any instance. Commands can follow each other with nothing in
+ * between; anything else between them (e.g. line endings) is skipped,
+ * as is a malformed prefix.
+ * 
+ * @param parser parser state, kept across chunks of the stream.
+ * @param byte next byte of the stream.
+ * @param[out] value command completed by byte, as PDM_TRANSPORT_COMMAND.
+ * 
+ * @return true if byte completed a command.
+ */
+bool PDMTransport_parseCommand(PDM_CommandParser_t *parser, const uint8_t byte, uint32_t *value);
+
+/**
+ * @brief Registers a transport so it's polled and can be addressed by id.
+ * 
+ * @param transport instance to register.
+ * @param id id the application will use to refer to it.
+ * 
+ * @return true if registered.
+ * @return false if the id is taken or there's no room left.
+ */
+bool PDMTransport_register(PDM_Transport_t *transport, const PDM_TransportId_t id);
+
+/**
+ * @brief Initializes a registered transport.
+ * 
+ * @return true if initalization succeeded.
+ */
+bool PDMTransport_init(PDM_Transport_t *transport);
+
+/**
+ * @brief Pushes a received value into the RX queue of a transport.
+ * 
+ * Meant to be called by transport implementations, from the main loop
+ * or from a driver callback (single producer).
+ * 
+ * @param transport transport that received the value.
+ * @param peer who sent it, as understood by the transport.
+ * @param value received value.
+ * 
+ * @return false if the queue was full and the value was dropped.
+ */
+bool PDMTransport_notify(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value);
+
+/**
+ * @brief Free slots in the RX queue of a transport.
+ * 
+ * Lets implementations that buffer on their own apply backpressure
+ * instead of having values dropped by PDMTransport_notify.
+ */
+uint8_t PDMTransport_rxSpace(const PDM_Transport_t *transport);
+
+/**
+ * @brief Queues a value to be sent through a transport.
+ * 
+ * @param id transport to send through.
+ * @param peer who to send it to, as received from PDMTransport_receive.
+ * @param value to be sent.
+ * 
+ * @return false if there's no such transport or its TX queue is full.
+ */
+bool PDMTransport_send(const PDM_TransportId_t id, const uint32_t peer, const uint32_t value);
+
+/**
+ * @brief Values queued for a transport and not sent yet.
+ * 
+ * @param id transport to check.
+ * 
+ * @return number of queued values, 0 if there's no such transport.
+ */
+uint8_t PDMTransport_txPending(const PDM_TransportId_t id);
+
+/**
+ * @brief Pulls the next received value, serving transports round-robin.
+ * 
+ * @param[out] id transport the value came from.
+ * @param[out] peer who sent it.
+ * @param[out] value received value.
+ * 
+ * @return true if a value was pulled.
+ */
+bool PDMTransport_receive(PDM_TransportId_t *id, uint32_t *peer, uint32_t *value);
+
+/**
+ * @brief Task to be run in the main loop of an application
+ *        to keep the module going. 
+ * 
+ * Polls every registered transport and flushes their TX queues.
+ */
+void PDMTransport_task();
+
+#endif // __PDM_TRANSPORT__
\ No newline at end of file
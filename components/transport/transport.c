@@ -0,0 +1,214 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "transport.h"
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/param.h>
+#include "esp_log.h"
+
+#define PDM_TRANSPORT_QUEUE_MASK (PDM_TRANSPORT_QUEUE_LEN - 1)
+
+static const char *TAG = "transport";
+
+/** Steps of PDMTransport_parseCommand.*/
+enum {
+    PDM_PARSE_IDLE = 0,       /**< Between commands.*/
+    PDM_PARSE_INSTANCE_FIRST, /**< After the prefix, waiting for the first instance digit.*/
+    PDM_PARSE_INSTANCE,       /**< Within the instance.*/
+    PDM_PARSE_COMMAND,        /**< After the separator, waiting for the command digit.*/
+};
+
+static PDM_Transport_t *transports[PDM_TRANSPORT_MAX];
+static uint8_t transportCount = 0;
+static uint8_t nextToServe = 0; /**< Round-robin cursor for PDMTransport_receive.*/
+
+/** Helpers ***************************************/
+static PDM_Transport_t *PDMTransport_find_(const PDM_TransportId_t id) {
+    for (uint8_t i = 0; i < transportCount; i++) {
+        if (transports[i]->id == id) {
+            return transports[i];
+        }
+    }
+    return NULL;
+}
+
+/** Public Methods ********************************/
+bool PDMTransport_queuePush(PDM_TransportQueue_t *queue, const uint32_t peer, const uint32_t value) {
+    const uint8_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if ((uint8_t)(head - atomic_load_explicit(&queue->tail, memory_order_acquire)) >= PDM_TRANSPORT_QUEUE_LEN) {
+        return false;
+    }
+    queue->items[head & PDM_TRANSPORT_QUEUE_MASK].value = value;
+    queue->items[head & PDM_TRANSPORT_QUEUE_MASK].peer = peer;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release); // Publish only once the item is in place.
+    return true;
+}
+
+bool PDMTransport_queuePeek(const PDM_TransportQueue_t *queue, PDM_TransportMessage_t *message) {
+    const uint8_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (atomic_load_explicit(&queue->head, memory_order_acquire) == tail) {
+        return false;
+    }
+    *message = queue->items[tail & PDM_TRANSPORT_QUEUE_MASK];
+    return true;
+}
+
+void PDMTransport_queueDrop(PDM_TransportQueue_t *queue) {
+    const uint8_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release); // Hands the slot back.
+}
+
+bool PDMTransport_parseCommand(PDM_CommandParser_t *parser, const uint8_t byte, uint32_t *value) {
+    const bool isDigit = byte >= '0' && byte <= '9';
+    switch (parser->step) {
+    case PDM_PARSE_INSTANCE_FIRST:
+    case PDM_PARSE_INSTANCE:
+        if (isDigit) {
+            // Saturates past the largest instance, so the whole command is skipped.
+            parser->instance = MIN(parser->instance * 10 + (byte - '0'), UINT16_MAX + 1);
+            parser->step = PDM_PARSE_INSTANCE;
+            return false;
+        }
+        if (byte == PDM_TRANSPORT_INSTANCE_SEPARATOR && parser->step == PDM_PARSE_INSTANCE) {
+            parser->step = PDM_PARSE_COMMAND;
+            return false;
+        }
+        break;
+    case PDM_PARSE_COMMAND:
+        if (isDigit) {
+            *value = PDM_TRANSPORT_COMMAND(byte - '0', parser->instance);
+            parser->step = PDM_PARSE_IDLE;
+            return parser->instance <= UINT16_MAX;
+        }
+        break;
+    default:
+        if (isDigit) {
+            *value = PDM_TRANSPORT_COMMAND(byte - '0', 0);
+            return true;
+        }
+        if (byte == PDM_TRANSPORT_INSTANCE_PREFIX) {
+            parser->instance = 0;
+            parser->step = PDM_PARSE_INSTANCE_FIRST;
+        }
+        return false;
+    }
+    ESP_LOGD(TAG, "Malformed command prefix, skipped");
+    parser->step = PDM_PARSE_IDLE;
+    return PDMTransport_parseCommand(parser, byte, value); // The byte may start the next command.
+}
+
+bool PDMTransport_register(PDM_Transport_t *transport, const PDM_TransportId_t id) {
+    if (transportCount >= PDM_TRANSPORT_MAX || PDMTransport_find_(id) != NULL) {
+        ESP_LOGE(TAG, "Unable to register %s with id %d", transport->name, id);
+        return false;
+    }
+    transport->id = id;
+    atomic_init(&transport->rx.head, 0);
+    atomic_init(&transport->rx.tail, 0);
+    atomic_init(&transport->tx.head, 0);
+    atomic_init(&transport->tx.tail, 0);
+    transports[transportCount++] = transport;
+    return true;
+}
+
+bool PDMTransport_init(PDM_Transport_t *transport) {
+    return transport->ops->init == NULL || transport->ops->init(transport);
+}
+
+bool PDMTransport_notify(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value) {
+    if (!PDMTransport_queuePush(&transport->rx, peer, value)) {
+        ESP_LOGE(TAG, "%s RX queue full, dropping %u", transport->name, value);
+        return false;
+    }
+    return true;
+}
+
+uint8_t PDMTransport_rxSpace(const PDM_Transport_t *transport) {
+    const uint8_t head = atomic_load_explicit(&transport->rx.head, memory_order_relaxed);
+    return PDM_TRANSPORT_QUEUE_LEN - (uint8_t)(head - atomic_load_explicit(&transport->rx.tail, memory_order_acquire));
+}
+
+bool PDMTransport_send(const PDM_TransportId_t id, const uint32_t peer, const uint32_t value) {
+    PDM_Transport_t *transport = PDMTransport_find_(id);
+    if (transport == NULL) {
+        ESP_LOGE(TAG, "No transport with id %d", id);
+        return false;
+    }
+    if (!PDMTransport_queuePush(&transport->tx, peer, value)) {
+        ESP_LOGE(TAG, "%s TX queue full, dropping %u", transport->name, value);
+        return false;
+    }
+    return true;
+}
+
+uint8_t PDMTransport_txPending(const PDM_TransportId_t id) {
+    const PDM_Transport_t *transport = PDMTransport_find_(id);
+    if (transport == NULL) {
+        return 0;
+    }
+    const uint8_t tail = atomic_load_explicit(&transport->tx.tail, memory_order_acquire);
+    return (uint8_t)(atomic_load_explicit(&transport->tx.head, memory_order_acquire) - tail);
+}
+
+bool PDMTransport_receive(PDM_TransportId_t *id, uint32_t *peer, uint32_t *value) {
+    for (uint8_t i = 0; i < transportCount; i++) {
+        PDM_Transport_t *transport = transports[(nextToServe + i) % transportCount];
+        PDM_TransportMessage_t message;
+        if (PDMTransport_queuePeek(&transport->rx, &message)) {
+            PDMTransport_queueDrop(&transport->rx);
+            *id = transport->id;
+            *peer = message.peer;
+            *value = message.value;
+            nextToServe = (nextToServe + i + 1) % transportCount;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PDMTransport_task() {
+    for (uint8_t i = 0; i < transportCount; i++) {
+        PDM_Transport_t *transport = transports[i];
+        if (transport->ops->poll != NULL) {
+            transport->ops->poll(transport);
+        }
+        PDM_TransportMessage_t message;
+        while (PDMTransport_queuePeek(&transport->tx, &message)) {
+            if (!transport->ops->send(transport, message.peer, message.value)) {
+                break; // Keep it queued and retry on the next run.
+            }
+            PDMTransport_queueDrop(&transport->tx);
+        }
+    }
+}
\ No newline at end of file
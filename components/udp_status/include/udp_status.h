@@ -0,0 +1,68 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+/**
+ * @brief UDP fast path for status queries.
+ * 
+ * Request datagram:  | 'P' | seq (2 bytes, big endian) | cmd | [instance] |
+ * Response datagram: | 'P' | seq (2 bytes, big endian) | cmd | value |
+ * 
+ * The optional instance byte picks the FSM instance queried (default 0).
+ * 
+ * Only the idempotent queries (0: blink speed, 1: BT status) to an
+ * existing instance are accepted. Anything else, or anything above the
+ * configured rate, is dropped without a response.
+*/
+#ifndef __PDM_UDP_STATUS__
+#define __PDM_UDP_STATUS__
+
+#include "transport.h"
+
+#define PDM_UDP_MAGIC 'P'
+#define PDM_UDP_REQUEST_LEN 4 /**< Without the optional instance byte.*/
+#define PDM_UDP_RESPONSE_LEN 5
+
+/**
+ * @brief Gets the UDP status transport.
+ * 
+ * Each value it delivers comes with a peer naming the request; the
+ * reply to that peer is sent back to whoever asked. Replies may come in
+ * any order, and requests left unanswered expire.
+ */
+PDM_Transport_t *PDMUdp_transport();
+
+/**
+ * @brief Sets the number of FSM instances, so queries to any other
+ *        instance are dropped here. 1 until set.
+ */
+void PDMUdp_setInstanceCount(const uint16_t count);
+
+#endif // __PDM_UDP_STATUS__
\ No newline at end of file
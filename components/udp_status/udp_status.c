@@ -0,0 +1,220 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "udp_status.h"
+
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#define PDM_UDP_PENDING_LEN PDM_TRANSPORT_QUEUE_LEN
+#define PDM_UDP_PENDING_TIMEOUT_MS 1000 /**< Unanswered queries free their slot after this. The client retries.*/
+
+/** Peer of a query handed to the application: its pending slot and the slot generation.*/
+#define PDM_UDP_PEER(slot, generation) (((uint32_t)(generation) << 8) | (slot))
+#define PDM_UDP_PEER_SLOT(peer) ((peer) & 0xFF)
+#define PDM_UDP_PEER_GENERATION(peer) ((uint8_t)((peer) >> 8))
+
+static const char *TAG = "udp_status";
+
+static bool PDMUdp_init_(PDM_Transport_t *transport);
+static void PDMUdp_poll_(PDM_Transport_t *transport);
+static bool PDMUdp_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value);
+
+static const PDM_TransportOps_t udpOps = {
+    .init = PDMUdp_init_,
+    .poll = PDMUdp_poll_,
+    .send = PDMUdp_send_,
+};
+
+static PDM_Transport_t udpTransport = {
+    .name = "udp",
+    .ops = &udpOps,
+};
+
+static int sock = -1;
+
+/** Pending Requests ******************************/
+/**
+ * @brief Query handed to the application, waiting for its reply.
+ * 
+ * Replies are matched to their query by peer, so they can come back
+ * in any order, or never.
+ */
+typedef struct {
+    struct sockaddr_in from;
+    uint8_t seq[2];
+    uint8_t cmd;
+    uint8_t generation; /**< Bumped every time the slot is taken, so stale replies don't match.*/
+    bool isUsed;
+    TickType_t since;   /**< When the query arrived.*/
+} PDM_UdpRequest_t;
+
+static PDM_UdpRequest_t pending[PDM_UDP_PENDING_LEN];
+static uint16_t instanceCount = 1;
+
+static PDM_UdpRequest_t *PDMUdp_takeSlot_() {
+    const TickType_t now = xTaskGetTickCount();
+    for (uint8_t i = 0; i < PDM_UDP_PENDING_LEN; i++) {
+        PDM_UdpRequest_t *entry = &pending[i];
+        if (entry->isUsed && now - entry->since >= pdMS_TO_TICKS(PDM_UDP_PENDING_TIMEOUT_MS)) {
+            ESP_LOGD(TAG, "Query %u unanswered, freeing its slot", (entry->seq[0] << 8) | entry->seq[1]);
+            entry->isUsed = false;
+        }
+        if (!entry->isUsed) {
+            entry->isUsed = true;
+            entry->generation++;
+            entry->since = now;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/** Rate Limiter **********************************/
+/**
+ * Credit is kept in query-microseconds: it grows by the rate every
+ * microsecond and a query costs a million. Refills are exact at any rate,
+ * above the tick rate too, with no rounding to carry between them.
+ */
+#define PDM_UDP_TOKEN 1000000LL
+static int64_t credit = CONFIG_PDM_UDP_BURST * PDM_UDP_TOKEN;
+static int64_t lastRefillUs;
+
+static bool PDMUdp_takeToken_() {
+    const int64_t now = esp_timer_get_time();
+    credit = MIN(credit + (now - lastRefillUs) * CONFIG_PDM_UDP_RATE_PER_SEC, CONFIG_PDM_UDP_BURST * PDM_UDP_TOKEN);
+    lastRefillUs = now;
+    if (credit < PDM_UDP_TOKEN) {
+        return false;
+    }
+    credit -= PDM_UDP_TOKEN;
+    return true;
+}
+
+/** Transport Operations **************************/
+static bool PDMUdp_init_(PDM_Transport_t *transport) {
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return false;
+    }
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_PDM_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        ESP_LOGE(TAG, "Unable to bind port %d: errno %d", CONFIG_PDM_UDP_PORT, errno);
+        close(sock);
+        sock = -1;
+        return false;
+    }
+    if (fcntl(sock, F_SETFL, O_NONBLOCK) < 0) {
+        ESP_LOGE(TAG, "Failed to set nonblocking error");
+    }
+    lastRefillUs = esp_timer_get_time();
+    ESP_LOGI(TAG, "Listening for status queries on port %d", CONFIG_PDM_UDP_PORT);
+    return true;
+}
+
+static void PDMUdp_poll_(PDM_Transport_t *transport) {
+    uint8_t request[PDM_UDP_REQUEST_LEN + 2]; // Instance byte, plus one to spot oversized datagrams.
+    // Bounded so a flood can't starve the rest of the loop.
+    for (uint8_t i = 0; i < PDM_UDP_PENDING_LEN; i++) {
+        struct sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+        int len = recvfrom(sock, request, sizeof(request), MSG_DONTWAIT,
+                           (struct sockaddr *)&from, &fromLen);
+        if (len < 0) {
+            return;
+        }
+        if (len < PDM_UDP_REQUEST_LEN || len > PDM_UDP_REQUEST_LEN + 1 ||
+            request[0] != PDM_UDP_MAGIC || request[3] > 1) {
+            ESP_LOGD(TAG, "Ignoring malformed datagram (%d bytes)", len);
+            continue;
+        }
+        const uint8_t instance = len > PDM_UDP_REQUEST_LEN ? request[PDM_UDP_REQUEST_LEN] : 0;
+        if (instance >= instanceCount) {
+            ESP_LOGD(TAG, "Ignoring query for instance %u", instance);
+            continue;
+        }
+        if (PDMTransport_rxSpace(transport) == 0 || !PDMUdp_takeToken_()) {
+            ESP_LOGD(TAG, "Rate limited, dropping query");
+            continue;
+        }
+        PDM_UdpRequest_t *entry = PDMUdp_takeSlot_();
+        if (entry == NULL) {
+            ESP_LOGD(TAG, "Too many queries in flight, dropping one");
+            continue;
+        }
+        entry->from = from;
+        entry->seq[0] = request[1];
+        entry->seq[1] = request[2];
+        entry->cmd = request[3];
+        if (!PDMTransport_notify(transport, PDM_UDP_PEER(entry - pending, entry->generation),
+                                 PDM_TRANSPORT_COMMAND(request[3], instance))) {
+            entry->isUsed = false;
+        }
+    }
+}
+
+static bool PDMUdp_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value) {
+    const uint8_t slot = PDM_UDP_PEER_SLOT(peer);
+    if (slot >= PDM_UDP_PENDING_LEN || !pending[slot].isUsed ||
+        pending[slot].generation != PDM_UDP_PEER_GENERATION(peer)) {
+        ESP_LOGD(TAG, "Reply %u to a query that timed out", value);
+        return true;
+    }
+    PDM_UdpRequest_t *entry = &pending[slot];
+    const uint8_t response[PDM_UDP_RESPONSE_LEN] = {
+        PDM_UDP_MAGIC, entry->seq[0], entry->seq[1], entry->cmd, (uint8_t)value,
+    };
+    if (sendto(sock, response, sizeof(response), 0,
+               (const struct sockaddr *)&entry->from, sizeof(entry->from)) < 0) {
+        ESP_LOGD(TAG, "Unable to send reply: errno %d", errno); // Lossy by design, the client retries.
+    }
+    entry->isUsed = false;
+    return true;
+}
+
+PDM_Transport_t *PDMUdp_transport() {
+    return &udpTransport;
+}
+
+void PDMUdp_setInstanceCount(const uint16_t count) {
+    instanceCount = count;
+}
\ No newline at end of file
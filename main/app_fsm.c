@@ -0,0 +1,398 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "app_fsm.h"
+
+#include <string.h>
+#include "transport.h"
+#include "tcp_client.h"
+#include "fsm_trace.h"
+#include "ota_update.h"
+#include "admission.h"
+#include "perf_stats.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "led_blinker.h"
+
+/************************************************************/
+/* FSM State Variables                                      */
+/************************************************************/
+/**
+ * @brief LED driven by each FSM instance. Instance 0 is the default
+ *        target of commands that don't name one.
+ */
+static const gpio_num_t actuatorGpios_[] = {
+    BLINK_GPIO,
+};
+#define PDM_FSM_INSTANCES (sizeof(actuatorGpios_) / sizeof(actuatorGpios_[0]))
+_Static_assert(PDM_FSM_INSTANCES <= PDM_BLINK_MAX_CHANNELS, "One blinker channel per instance");
+
+#define PDM_FSM_BATCH_LEN 16 /**< Events dispatched per pass.*/
+#define PDM_RESTART_DRAIN_TIMEOUT_MS 5000 /**< Restarts anyway if the update result can't be sent.*/
+#define PDM_RESTART_GRACE_MS 500          /**< Left to the stack to deliver the result and FIN.*/
+
+/**
+ * @brief Steps from a new image being ready to restarting into it, so
+ *        the server gets the update result first.
+ */
+typedef enum {
+    PDM_RESTART_NONE,
+    PDM_RESTART_DRAINING, /**< Result queued, waiting for the TCP transport to send it.*/
+    PDM_RESTART_CLOSING,  /**< Connection closed, giving the stack time to flush it.*/
+    PDM_RESTART_DUE,
+} PDM_RestartStage_t;
+
+static PDM_Fsm_t fsm_; /**< Blinker FSM engine.*/
+static PDM_FsmState_t fsmStates_[PDM_FSM_INSTANCES]; /**< Current state of every instance.*/
+static PDM_RestartStage_t restartStage_ = PDM_RESTART_NONE;
+static TickType_t restartStageSince_;
+static PDM_FsmEvent_t batch_[PDM_FSM_BATCH_LEN]; /**< Events waiting to be dispatched.*/
+#define PDM_NOT_BATCHED PDM_FSM_BATCH_LEN /**< Batch index of an event answered without being dispatched.*/
+static size_t dispatchIndex_ = PDM_NOT_BATCHED; /**< Index in batch_ of the event being dispatched.*/
+#ifdef LORSI_ADMISSION
+#define PDM_NO_REPLY -1
+static uint8_t batchLeaders_[PDM_FSM_BATCH_LEN]; /**< Coalescing slot each batched event leads, if any.*/
+static int16_t leaderReplies_[PDM_ADMISSION_COALESCE_SLOTS]; /**< Reply of each leader, for the events coalesced with it.*/
+#endif
+
+/************************************************************/
+/* FSM Handlers                                             */
+/************************************************************/
+static inline bool isBtEnabled(const PDM_FsmState_t state) {
+    return state != BT_DISABLED;
+}
+
+static inline uint32_t getBlinkingStatusCode(const PDM_FsmState_t state) {
+    return (uint32_t)state; // Code matches state enum value.
+}
+
+/**
+ * @brief Replies to the peer an event came from.
+ *
+ * @param index of the event in batch_, or PDM_NOT_BATCHED.
+ */
+static inline void reply(const size_t index, const PDM_FsmEvent_t *event, const uint32_t value) {
+#ifdef LORSI_ADMISSION
+    if (index < PDM_FSM_BATCH_LEN && batchLeaders_[index] != PDM_ADMISSION_NO_LEADER) {
+        leaderReplies_[batchLeaders_[index]] = value; // Also the answer of the events coalesced with it.
+    }
+#endif
+    PDMTransport_send((PDM_TransportId_t)event->source, event->peer, value);
+}
+
+static void sendCurrentBlinkSpeed(const PDM_FsmEvent_t *event, const PDM_FsmState_t state) {
+    reply(dispatchIndex_, event, getBlinkingStatusCode(state));
+}
+
+static void sendCurrentBTServiceStatus(const PDM_FsmEvent_t *event, const PDM_FsmState_t state) {
+    reply(dispatchIndex_, event, isBtEnabled(state) ? 0 : 1);
+}
+
+/** Acknowledges a speed toggle with the speed the LED switches to. */
+static void sendToggledBlinkSpeed(const PDM_FsmEvent_t *event, const PDM_FsmState_t state) {
+    reply(dispatchIndex_, event, getBlinkingStatusCode(state == SLOW_BLINK ? FAST_BLINK : SLOW_BLINK));
+}
+
+#ifdef LORSI_OTA
+/** Receives the firmware stream that follows command 3. */
+static bool otaStreamSink(const uint8_t *data, const size_t len) {
+    PDM_OtaStatus_t status = PDM_OTA_FAILED;
+    if (data == NULL) {
+        PDMOta_abort(); // Stream stalled.
+    } else {
+        status = PDMOta_write(data, len);
+    }
+    if (status == PDM_OTA_IN_PROGRESS) {
+        return true;
+    }
+    PDMTransport_send(PDM_WIFI, 0, status == PDM_OTA_DONE ? 0 : 1);
+    uint32_t left;
+    if (status == PDM_OTA_FAILED) {
+        // The server keeps streaming: none of it may be taken for commands.
+        PDMNetwork_discardStream(data != NULL && PDMOta_streamLeft(&left) ? left : SIZE_MAX);
+    }
+    if (status == PDM_OTA_DONE) {
+        restartStage_ = PDM_RESTART_DRAINING;
+        restartStageSince_ = xTaskGetTickCount();
+    }
+    return false;
+}
+
+static void startFirmwareUpdate(const PDM_FsmEvent_t *event, const PDM_FsmState_t state) {
+    if (!PDMOta_begin()) {
+        reply(dispatchIndex_, event, 1);
+        return;
+    }
+    PDMNetwork_setStreamSink(otaStreamSink);
+    reply(dispatchIndex_, event, 0); // Ready, the server can start streaming.
+}
+#endif
+
+/************************************************************/
+/* FSM Definition                                           */
+/************************************************************/
+static const PDM_FsmEntry_t fsmTable_[] = {
+    {BT_DISABLED,  {PDM_WIFI, 0},    BT_DISABLED,  sendCurrentBlinkSpeed},
+    {SLOW_BLINK,   {PDM_WIFI, 0},    SLOW_BLINK,   sendCurrentBlinkSpeed},
+    {FAST_BLINK,   {PDM_WIFI, 0},    FAST_BLINK,   sendCurrentBlinkSpeed},
+
+    {BT_DISABLED,  {PDM_WIFI, 1},    BT_DISABLED,  sendCurrentBTServiceStatus},
+    {SLOW_BLINK,   {PDM_WIFI, 1},    SLOW_BLINK,   sendCurrentBTServiceStatus},
+    {FAST_BLINK,   {PDM_WIFI, 1},    FAST_BLINK,   sendCurrentBTServiceStatus},
+
+    {BT_DISABLED,  {PDM_WIFI, 2},    FAST_BLINK,    sendCurrentBTServiceStatus},
+    {SLOW_BLINK,   {PDM_WIFI, 2},    BT_DISABLED,   sendCurrentBTServiceStatus},
+    {FAST_BLINK,   {PDM_WIFI, 2},    BT_DISABLED,   sendCurrentBTServiceStatus},
+
+#ifdef LORSI_OTA
+    {BT_DISABLED,  {PDM_WIFI, 3},    BT_DISABLED,  startFirmwareUpdate},
+    {SLOW_BLINK,   {PDM_WIFI, 3},    SLOW_BLINK,   startFirmwareUpdate},
+    {FAST_BLINK,   {PDM_WIFI, 3},    FAST_BLINK,   startFirmwareUpdate},
+#endif
+
+    {BT_DISABLED,  {PDM_UDP, 0},     BT_DISABLED,  sendCurrentBlinkSpeed},
+    {SLOW_BLINK,   {PDM_UDP, 0},     SLOW_BLINK,   sendCurrentBlinkSpeed},
+    {FAST_BLINK,   {PDM_UDP, 0},     FAST_BLINK,   sendCurrentBlinkSpeed},
+
+    {BT_DISABLED,  {PDM_UDP, 1},     BT_DISABLED,  sendCurrentBTServiceStatus},
+    {SLOW_BLINK,   {PDM_UDP, 1},     SLOW_BLINK,   sendCurrentBTServiceStatus},
+    {FAST_BLINK,   {PDM_UDP, 1},     FAST_BLINK,   sendCurrentBTServiceStatus},
+
+    {SLOW_BLINK,   {PDM_BT, 0},      FAST_BLINK,    sendToggledBlinkSpeed},
+    {FAST_BLINK,   {PDM_BT, 1},      SLOW_BLINK,    sendToggledBlinkSpeed},
+
+    {SLOW_BLINK,   {PDM_BT, 2},      SLOW_BLINK,    sendCurrentBlinkSpeed},
+    {FAST_BLINK,   {PDM_BT, 2},      FAST_BLINK,    sendCurrentBlinkSpeed},
+};
+
+#ifdef LORSI_ADMISSION
+/**
+ * @brief Admission rules, per source and command class.
+ * 
+ * UDP is already rate limited by udp_status, before a query takes one
+ * of its pending slots, so it isn't limited again here.
+ */
+static const PDM_AdmissionRule_t admissionRules_[PDM_SOURCE_COUNT][PDM_CMD_CLASS_COUNT] = {
+    /*               Query                           Control                        Update */
+    [PDM_NONE] = {{0,   0, PDM_OVERLOAD_DROP},     {0,    0, PDM_OVERLOAD_DROP}, {0,     0, PDM_OVERLOAD_DROP}},
+    [PDM_WIFI] = {{100, 5, PDM_OVERLOAD_COALESCE}, {1000, 2, PDM_OVERLOAD_BUSY}, {60000, 1, PDM_OVERLOAD_BUSY}},
+    [PDM_BT]   = {{100, 5, PDM_OVERLOAD_COALESCE}, {500,  3, PDM_OVERLOAD_DROP}, {0,     0, PDM_OVERLOAD_DROP}},
+    [PDM_UDP]  = {{0,   0, PDM_OVERLOAD_BUSY},     {0,    0, PDM_OVERLOAD_BUSY}, {0,     0, PDM_OVERLOAD_BUSY}},
+};
+#endif
+
+/************************************************************/
+/* FSM Methods                                              */
+/************************************************************/
+/** Drives the LED of the instance, answers rejected events and records the dispatch. */
+static void fsmObserve_(const PDM_FsmDispatch_t *dispatch) {
+    if(dispatch->rejected) {
+        reply(dispatchIndex_, dispatch->event, PDM_ERROR_REPLY);
+    } else if(dispatch->matched && dispatch->nextState != dispatch->prevState) {
+        // Code matches state enum value. Queries leave the blink phase alone, or polling freezes the LED.
+        PDMBlink_ChannelSpeedUpdate(dispatch->event->instance, (PDM_BlinkSpeed_t)dispatch->nextState);
+    }
+#ifdef LORSI_TRACE
+    const PDM_FsmEvent_t *event = dispatch->event;
+    const PDM_TraceRecord_t record = {
+        .timestampMs = (uint32_t)(esp_timer_get_time() / 1000),
+        .data = event->data > UINT8_MAX ? UINT8_MAX : event->data,
+        .instance = event->instance > UINT8_MAX ? UINT8_MAX : event->instance,
+        .handlerUs = dispatch->handlerUs > UINT16_MAX ? UINT16_MAX : dispatch->handlerUs,
+        .source = event->source,
+        .prevState = dispatch->prevState,
+        .nextState = dispatch->nextState,
+        .flags = (dispatch->matched ? PDM_TRACE_FLAG_MATCHED : 0) | (dispatch->rejected ? PDM_TRACE_FLAG_REJECTED : 0),
+        .peer = event->peer,
+    };
+    PDMTrace_record(&record);
+#endif
+    dispatchIndex_++; // Called once per event, after its handler.
+}
+
+#ifdef LORSI_ADMISSION
+/** Classifies a command by what the table does with it: queries never change the state. */
+static PDM_CommandClass_t fsmClassify_(const PDM_FsmEvent_t *event) {
+    PDM_CommandClass_t commandClass = PDM_CMD_QUERY;
+    for (size_t i = 0; i < sizeof(fsmTable_)/sizeof(PDM_FsmEntry_t); i++) {
+        const PDM_FsmEntry_t *entry = &fsmTable_[i];
+        if (entry->event.source != event->source || entry->event.data != event->data) {
+            continue;
+        }
+#ifdef LORSI_OTA
+        if (entry->handler == startFirmwareUpdate) {
+            return PDM_CMD_UPDATE;
+        }
+#endif
+        if (entry->nextState != entry->currentState) {
+            commandClass = PDM_CMD_CONTROL;
+        }
+    }
+    return commandClass;
+}
+#endif
+
+/** Dispatches the first count events of batch_. */
+static void fsmDispatch_(const size_t count) {
+    dispatchIndex_ = 0;
+    PDMFsm_dispatch(&fsm_, batch_, count);
+    dispatchIndex_ = PDM_NOT_BATCHED; // Handlers may also run on events dispatched from elsewhere.
+}
+
+static void fsmSpin_() {
+    size_t count = 0;
+    PDM_TransportId_t source;
+    uint32_t peer;
+    uint32_t value;
+#ifdef LORSI_ADMISSION
+    PDMAdmission_beginBatch();
+#endif
+    while(PDMTransport_receive(&source, &peer, &value)) {
+#ifdef LORSI_PERF
+        PDMPerf_addEvents(1);
+#endif
+        const PDM_FsmEvent_t event = {
+            .source = source,
+            .data = PDM_TRANSPORT_COMMAND_CODE(value),
+            .peer = peer,
+            .instance = PDM_TRANSPORT_COMMAND_INSTANCE(value),
+        };
+#ifdef LORSI_ADMISSION
+        uint8_t leader = PDM_ADMISSION_NO_LEADER;
+        // Events for a missing instance are rejected by the FSM, in order, and cost no token.
+        if(event.instance < PDM_FSM_INSTANCES) {
+            const PDM_CommandClass_t commandClass = fsmClassify_(&event);
+            const PDM_AdmitResult_t admit = PDMAdmission_check(event.source, commandClass,
+                                                               PDM_TRANSPORT_COMMAND(event.data, event.instance), &leader);
+            if(admit == PDM_ADMIT_BUSY || admit == PDM_ADMIT_COALESCED) {
+                fsmDispatch_(count); // Keep replies in order, and get the leader's.
+                count = 0;
+                if(admit == PDM_ADMIT_BUSY) {
+                    reply(PDM_NOT_BATCHED, &event, PDM_BUSY_REPLY);
+                } else if(leaderReplies_[leader] != PDM_NO_REPLY) {
+                    reply(PDM_NOT_BATCHED, &event, leaderReplies_[leader]);
+                }
+            }
+            if(admit != PDM_ADMIT_OK) {
+                continue;
+            }
+            if(commandClass != PDM_CMD_QUERY) {
+                // It may change what the queries admitted so far would answer.
+                PDMAdmission_beginBatch();
+                memset(batchLeaders_, PDM_ADMISSION_NO_LEADER, count);
+                leader = PDM_ADMISSION_NO_LEADER;
+            }
+        }
+        batchLeaders_[count] = leader;
+        if(leader != PDM_ADMISSION_NO_LEADER) {
+            leaderReplies_[leader] = PDM_NO_REPLY; // Until it's dispatched.
+        }
+#endif
+        batch_[count++] = event;
+        if(count == PDM_FSM_BATCH_LEN) {
+            fsmDispatch_(count);
+            count = 0;
+        }
+    }
+    fsmDispatch_(count);
+}
+
+/************************************************************/
+/* Public Methods                                           */
+/************************************************************/
+void PDMApp_init() {
+#ifdef LORSI_TRACE
+    PDMTrace_init();
+#endif
+    PDMBlink_Init(PDM_BLINK_ALWAYS_ON);
+    for(uint8_t i = 1; i < PDM_FSM_INSTANCES; i++) {
+        PDMBlink_ChannelInit(i, actuatorGpios_[i], PDM_BLINK_ALWAYS_ON);
+    }
+    PDMFsm_init(&fsm_, fsmTable_, sizeof(fsmTable_)/sizeof(PDM_FsmEntry_t),
+                fsmStates_, PDM_FSM_INSTANCES, BT_DISABLED, fsmObserve_);
+#ifdef LORSI_ADMISSION
+    PDMAdmission_init(&admissionRules_[0][0], PDM_SOURCE_COUNT, PDM_CMD_CLASS_COUNT);
+#endif
+}
+
+/**
+ * @brief Replaces the main loop pass once a restart is pending: only the
+ *        update result goes out, no new commands are taken.
+ */
+static void restartSpin_() {
+    const TickType_t elapsed = xTaskGetTickCount() - restartStageSince_;
+    if (restartStage_ == PDM_RESTART_DRAINING) {
+        PDMTransport_task(); // Also retries a result TLS couldn't write yet.
+        if (PDMTransport_txPending(PDM_WIFI) == 0 || elapsed >= pdMS_TO_TICKS(PDM_RESTART_DRAIN_TIMEOUT_MS)) {
+            PDMNetwork_close();
+            restartStage_ = PDM_RESTART_CLOSING;
+            restartStageSince_ = xTaskGetTickCount();
+        }
+    } else if (restartStage_ == PDM_RESTART_CLOSING && elapsed >= pdMS_TO_TICKS(PDM_RESTART_GRACE_MS)) {
+        restartStage_ = PDM_RESTART_DUE;
+    }
+}
+
+void PDMApp_loop() {
+    PDMBlink_Task();
+    if (restartStage_ != PDM_RESTART_NONE) {
+        restartSpin_();
+        return;
+    }
+    PDMTransport_task();
+    fsmSpin_();
+#ifdef LORSI_ADMISSION
+    static TickType_t lastStatsLog = 0;
+    if(xTaskGetTickCount() - lastStatsLog >= pdMS_TO_TICKS(CONFIG_PDM_ADMISSION_LOG_PERIOD_S * 1000)) {
+        lastStatsLog = xTaskGetTickCount();
+        PDMAdmission_logStats();
+    }
+#endif
+}
+
+bool PDMApp_isRestartDue() {
+    return restartStage_ == PDM_RESTART_DUE;
+}
+
+const PDM_FsmEntry_t *PDMApp_table(size_t *len) {
+    *len = sizeof(fsmTable_)/sizeof(PDM_FsmEntry_t);
+    return fsmTable_;
+}
+
+uint16_t PDMApp_instanceCount() {
+    return PDM_FSM_INSTANCES;
+}
+
+const PDM_Fsm_t *PDMApp_fsm() {
+    return &fsm_;
+}
@@ -0,0 +1,155 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * @brief Blinker application: the FSM table, its handlers and the event pump.
+ * 
+ * Everything here runs on top of the transport layer and builds on the
+ * host as well, so the same table can be replayed and benchmarked there.
+ * Board and network bring-up stay in application.c.
+*/
+#ifndef __PDM_APP_FSM__
+#define __PDM_APP_FSM__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "fsm.h"
+
+/************************************************************/
+/* Feature Enable/Disable Defines                           */
+/************************************************************/
+#define LORSI_NET  /**< Enables WiFi Client.*/
+#define LORSI_BT /**< Enables BT Server.*/
+#ifdef CONFIG_PDM_UDP_ENABLED
+#define LORSI_UDP /**< Enables UDP status queries.*/
+#endif
+#ifdef CONFIG_PDM_TRACE_ENABLED
+#define LORSI_TRACE /**< Enables the FSM trace recorder.*/
+#endif
+#ifdef CONFIG_PDM_OTA_ENABLED
+#define LORSI_OTA /**< Enables firmware updates from the TCP server.*/
+#endif
+#ifdef CONFIG_PDM_ADMISSION_ENABLED
+#define LORSI_ADMISSION /**< Enables rate limiting in front of the FSM.*/
+#endif
+#ifdef CONFIG_PDM_PERF_ENABLED
+#define LORSI_PERF /**< Enables the main loop performance report.*/
+#endif
+
+#define PDM_ERROR_REPLY 8 /**< Reply to commands for an instance (LED) the board doesn't have.*/
+#define PDM_BUSY_REPLY 9  /**< Reply to commands refused by admission control.*/
+
+/************************************************************/
+/* Type Definitions                                         */
+/************************************************************/
+
+/**
+ * @brief Source of an incoming event.
+ * 
+ * Events can be originated from either the TCP server or
+ * the BT client. Values double as transport ids, so replies
+ * go back through the transport the event came from.
+ */
+typedef enum {
+    PDM_NONE, /**< No source. Only used at the start of the program.*/
+    PDM_WIFI, /**< Event from WiFi. Currently it identifies a message from the TCP server.*/
+    PDM_BT,   /**< Event from BT Serial.*/
+    PDM_UDP,  /**< Status query from the UDP fast path.*/
+    PDM_SOURCE_COUNT, /**< Number of sources. Not a source.*/
+} PDM_DataSource_t;
+
+/**
+ * @brief Command classes, rate limited separately.
+ */
+typedef enum {
+    PDM_CMD_QUERY = 0, /**< Idempotent status queries.*/
+    PDM_CMD_CONTROL,   /**< Commands that change the state.*/
+    PDM_CMD_UPDATE,    /**< Firmware updates.*/
+    PDM_CMD_CLASS_COUNT, /**< Number of classes. Not a class.*/
+} PDM_CommandClass_t;
+
+/**
+ * @brief FSM states type.
+ */
+typedef enum {
+    SLOW_BLINK = 0, /**< BuiltIn LED Blinking slowly.*/
+    FAST_BLINK,  /**< BuiltIn LED Blinking fast.*/
+    BT_DISABLED,  /**< BlueTooth events ignored - LED always on.*/
+} PDM_State_t;
+
+/************************************************************/
+/* Public Methods                                           */
+/************************************************************/
+
+/**
+ * @brief Sets up the LEDs, the FSM and admission control.
+ * 
+ * Transports are registered by the caller, with PDM_DataSource_t
+ * values as ids.
+ */
+void PDMApp_init();
+
+/**
+ * @brief One pass of the main loop: drives the LEDs, runs the transports
+ *        and feeds everything they received to the FSM.
+ */
+void PDMApp_loop();
+
+/**
+ * @brief Whether a new firmware image is ready and the board should
+ *        restart now.
+ * 
+ * Only true once the update result left the TX queue, the connection
+ * was closed and a grace period went by, so the server reads the result
+ * instead of a reset.
+ */
+bool PDMApp_isRestartDue();
+
+/**
+ * @brief Gets the transition table of the application.
+ * 
+ * @param[out] len number of entries.
+ */
+const PDM_FsmEntry_t *PDMApp_table(size_t *len);
+
+/**
+ * @brief Number of FSM instances (one per LED).
+ */
+uint16_t PDMApp_instanceCount();
+
+/**
+ * @brief Gets the running FSM, e.g. to inspect the state of an instance.
+ */
+const PDM_Fsm_t *PDMApp_fsm();
+
+#endif // __PDM_APP_FSM__
@@ -0,0 +1,156 @@
+'''MIT License
+
+Copyright (c) 2021 Lucas Orsi (lorsi 96) 
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+'''
+
+import argparse
+import json
+import re
+import sys
+
+PERF_LINE = re.compile(r'PERF (\{.*\})')
+
+# Metric -> True if higher is better. Anything else in a summary is informative only.
+METRICS = {
+    'events_per_s': True,
+    'duty_permille': False,
+    'loop_us_p50': False,
+    'loop_us_p99': False,
+    'loop_us_max': False,
+    'stack_free': True,
+    'heap_min': True,
+    # Host benchmark suite (test/host/bench_suite).
+    'latency_ms_p50': False,
+    'latency_ms_p99': False,
+    'latency_ms_max': False,
+    'lost': False,
+    'reconnect_ms_max': False,
+    'heap_peak': False,
+    'stack_used': False,
+}
+
+
+def read_windows(stream):
+    '''Yields the PERF reports found in an ESP32 log (e.g. idf.py monitor output).'''
+    for line in stream:
+        match = PERF_LINE.search(line)
+        if match:
+            try:
+                yield json.loads(match.group(1))
+            except ValueError:
+                continue  # Line garbled by the serial link.
+
+
+def summarize(windows):
+    '''Reduces the windows of a run to one value per metric, worst case where it matters.'''
+    total_ms = sum(w['window_ms'] for w in windows)
+    p50s = sorted(w['loop_us_p50'] for w in windows)
+    return {
+        'windows': len(windows),
+        'events_per_s': sum(w['events'] for w in windows) * 1000.0 / total_ms,
+        'busy_passes_per_s': sum(w['busy_passes'] for w in windows) * 1000.0 / total_ms,
+        'duty_permille': sum(w['duty_permille'] * w['window_ms'] for w in windows) / float(total_ms),
+        'loop_us_p50': p50s[len(p50s) // 2],
+        'loop_us_p99': max(w['loop_us_p99'] for w in windows),
+        'loop_us_max': max(w['loop_us_max'] for w in windows),
+        'stack_free': min(w['stack_free'] for w in windows),
+        'heap_min': min(w['heap_min'] for w in windows),
+    }
+
+
+def relative_change(now, before):
+    '''Change from before to now. From zero, any change is an infinite one.'''
+    if before:
+        return (now - before) / float(abs(before))
+    if now == before:
+        return 0.0
+    return float('inf') if now > before else float('-inf')
+
+
+def compare(summary, baseline, tolerance, tolerances=None, name=''):
+    '''Prints every metric against the baseline. Returns the regressed ones.
+
+    tolerances overrides the allowed relative regression per metric.
+    '''
+    regressions = []
+    for metric, higher_is_better in METRICS.items():
+        now, before = summary.get(metric), baseline.get(metric)
+        if now is None or before is None:
+            continue
+        change = relative_change(now, before)
+        worse = -change if higher_is_better else change
+        regressed = worse > (tolerances or {}).get(metric, tolerance)
+        label = '{}.{}'.format(name, metric) if name else metric
+        print('{:<28} {:>12.1f} {:>12.1f} {:>+8.1%}{}'.format(
+            label, before, now, change, '  REGRESSION' if regressed else ''))
+        if regressed:
+            regressions.append(label)
+    return regressions
+
+
+def compare_results(results, baseline, tolerance):
+    '''Compares every workload of a host suite run. Workloads missing from either side regress.'''
+    tolerances = baseline.get('tolerances', {})
+    regressions = []
+    for name, expected in sorted(baseline['workloads'].items()):
+        if name not in results['workloads']:
+            print('{:<28} missing from the results  REGRESSION'.format(name))
+            regressions.append(name)
+            continue
+        regressions += compare(results['workloads'][name], expected, tolerance, tolerances, name)
+    return regressions
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Summarizes the PERF lines of an ESP32 log (CONFIG_PDM_PERF_ENABLED), '
+                                                 'or the results of the host benchmark suite.')
+    parser.add_argument('log', nargs='?', help='log file, stdin if omitted')
+    parser.add_argument('--results', metavar='JSON', help='host suite results (bench_suite) instead of a log')
+    parser.add_argument('--save', metavar='JSON', help='store the summary as the new baseline')
+    parser.add_argument('--baseline', metavar='JSON', help='compare against a stored baseline')
+    parser.add_argument('--tolerance', type=float, default=0.2,
+                        help='allowed relative regression, unless the baseline sets one (default 0.2)')
+    args = parser.parse_args()
+
+    if args.results:
+        with open(args.results) as f:
+            summary = json.load(f)
+    else:
+        stream = open(args.log) if args.log else sys.stdin
+        windows = list(read_windows(stream))
+        if not windows:
+            print('No PERF lines found')
+            exit(2)
+        summary = summarize(windows)
+        print(json.dumps(summary, indent=2))
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(summary, f, indent=2)
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if args.results:
+            regressions = compare_results(summary, baseline, args.tolerance)
+        else:
+            regressions = compare(summary, baseline, args.tolerance, baseline.get('tolerances'))
+        if regressions:
+            print('Regressed: {}'.format(', '.join(regressions)))
+            exit(1)
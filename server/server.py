@@ -24,7 +24,10 @@ SOFTWARE.
 import os
 import re
 import socket
+import ssl
+import struct
 import time
+import zlib
 import sys
 from random import randint
 import fcntl
@@ -32,13 +35,21 @@ from builtins import input
 from threading import Event, Thread
 
 PORT = 3333
+TLS_CERT = os.environ.get('PDM_TLS_CERT')  # Set both to serve over TLS (CONFIG_PDM_NET_TLS).
+TLS_KEY = os.environ.get('PDM_TLS_KEY')
+OTA_WINDOW_BITS = 12  # Must not exceed CONFIG_PDM_OTA_WINDOW_BITS.
+OTA_CHUNK = 4096
+ERROR_REPLY = '8'  # Sent by the ESP32 when a command targets an LED it doesn't have.
+BUSY_REPLY = '9'  # Sent by the ESP32 when a command is rate limited.
 MENU_STR = '''
 -------------------------------------------------------
 Choose one of the following options and press [Enter]
 (0) Query Blink Speed.
 (1) Query Server status.
 (2) Toggle Bluetooth Server on/off. 
+(3) Update firmware.
 (9) Exit.
+Append a digit to address another LED (e.g. 21 toggles LED 1).
 -------------------------------------------------------
 
 '''
@@ -46,7 +57,8 @@ Choose one of the following options and press [Enter]
 CMD_SENT_MESSAGES = {
     '0': 'Asking ESP32 for its current blink speed...',
     '1': 'Asking ESP32 for its current BT server status...',
-    '2': 'Asked ESP32 to toggle its BT service...'
+    '2': 'Asked ESP32 to toggle its BT service...',
+    '3': 'Asking ESP32 to get ready for a firmware update...'
 }
 
 BLINK_SPEED_DECODER = {
@@ -65,13 +77,42 @@ SERVER_TOGGLE_DECODER = {
     '1': 'ESP32 turned On its BT server'
 }
 
+OTA_READY_DECODER = {
+    '0': 'ESP32 is ready to receive the firmware',
+    '1': 'ESP32 refused the update'
+}
+
+OTA_RESULT_DECODER = {
+    '0': 'ESP32 verified the firmware and is restarting',
+    '1': 'ESP32 rejected the firmware, still running the old one'
+}
+
 DECODERS = {
     '0': BLINK_SPEED_DECODER,
     '1': SERVER_STATUS_DECODER,
-    '2': SERVER_TOGGLE_DECODER
+    '2': SERVER_TOGGLE_DECODER,
+    '3': OTA_READY_DECODER
 }
 
 
+def send_firmware(conn, path):
+    '''Streams a firmware image, zlib compressed, in the format ota_update.h expects.'''
+    with open(path, 'rb') as f:
+        image = f.read()
+    compressor = zlib.compressobj(9, zlib.DEFLATED, OTA_WINDOW_BITS)
+    compressed = compressor.compress(image) + compressor.flush()
+    print('Sending {} bytes ({} compressed)...'.format(len(image), len(compressed)))
+    start = time.monotonic()
+    conn.sendall(b'POTA' + struct.pack('<II', len(compressed), len(image)))
+    for offset in range(0, len(compressed), OTA_CHUNK):
+        conn.sendall(compressed[offset:offset + OTA_CHUNK])
+    data = conn.recv(1024, )
+    elapsed = time.monotonic() - start
+    if data:
+        print(OTA_RESULT_DECODER[str(data)[2]])
+    print('Took {:.1f} s ({:.1f} KB/s of image)'.format(elapsed, len(image) / 1024 / elapsed))
+
+
 class TcpServer:
     def __init__(self, port, family_addr, persist=False):
         self.port = port
@@ -82,6 +123,10 @@ class TcpServer:
         self.shutdown = Event()
         self.persist = persist
         self.family_addr = family_addr
+        self.tls_context = None
+        if TLS_CERT and TLS_KEY:
+            self.tls_context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+            self.tls_context.load_cert_chain(TLS_CERT, TLS_KEY)
 
     def __enter__(self):
         try:
@@ -112,17 +157,34 @@ class TcpServer:
             try:
                 conn, address = self.socket.accept()  # accept new connection
                 print('Connection from: {}'.format(address))
+                if self.tls_context:
+                    conn.setblocking(True)
+                    conn = self.tls_context.wrap_socket(conn, server_side=True)
+                    print('TLS session reused: {}'.format(conn.session_reused))
                 while 1:
                     print(MENU_STR)
                     choice = input()
+                    command, instance = choice[:1], choice[1:]  # Optional: target instance.
+                    if command not in CMD_SENT_MESSAGES and command != '9':
+                        continue
                     if choice == '9':
                         conn.close()
                         exit(0)
-                    print(CMD_SENT_MESSAGES[choice])
-                    conn.send(str(choice).encode())
+                    firmware = input('Path to the firmware image: ') if command == '3' else None
+                    print(CMD_SENT_MESSAGES[command])
+                    framed = '@{}:{}'.format(int(instance), command) if instance.isdigit() else command
+                    conn.send(framed.encode())
                     data = conn.recv(1024, )
+                    if data and str(data)[2] == BUSY_REPLY:
+                        print('ESP32 is busy, try again later')
+                        continue
+                    if data and str(data)[2] == ERROR_REPLY:
+                        print('ESP32 has no LED {}'.format(instance))
+                        continue
                     if data:
-                        print(DECODERS[choice][str(data)[2]]) # Data comes in "b'n\0" format, where n is the interesting part.    
+                        print(DECODERS[command][str(data)[2]]) # Data comes in "b'n\0" format, where n is the interesting part.    
+                    if firmware and data and str(data)[2] == '0':
+                        send_firmware(conn, firmware)
                     time.sleep(1)
                 conn.close()
             except socket.error as e:
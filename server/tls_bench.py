@@ -0,0 +1,166 @@
+'''MIT License
+
+Copyright (c) 2021 Lucas Orsi (lorsi 96) 
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+'''
+
+import argparse
+import json
+import re
+import socket
+import ssl
+import statistics
+import sys
+import time
+
+PORT = 3333
+QUERY = b'0'  # Blink speed query, answered by the ESP32 without side effects.
+
+# Logged by tcp_client.c after every handshake.
+DEVICE_LINE = re.compile(r'TLS handshake done in (\d+) ms \(session offered: (yes|no)\), '
+                         r'heap peak (\d+), kept (-?\d+), stack free (\d+)')
+
+USAGE = '''
+Stand-in TLS server comparing full and resumed handshakes of the ESP32.
+
+Every connection is closed right after one status query, so the ESP32 reconnects
+and handshakes again. The first half of the run gives every connection a fresh
+TLS context, which forces full handshakes; the second half shares one context so
+the ESP32 can resume the session it got. Capture the device log at the same time
+(e.g. idf.py monitor | tee device.log) and pass it with --log to add the device
+side handshake time, heap peak and free stack to the report.
+'''
+
+
+def percentile(values, pct):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * pct / 100))]
+
+
+def summarize(values):
+    if not values:
+        return None
+    return {
+        'count': len(values),
+        'p50': percentile(values, 50),
+        'p90': percentile(values, 90),
+        'max': max(values),
+        'mean': round(statistics.mean(values), 1),
+    }
+
+
+def new_context(cert, key):
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(cert, key)
+    # mbedTLS resumes TLS 1.2 sessions, keep both sides on it.
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+    return context
+
+
+def serve(args):
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(('', args.port))
+    server.listen(1)
+    server.settimeout(args.timeout)
+    shared = new_context(args.cert, args.key)
+    results = []
+    print('Waiting for {} connections on port {}'.format(args.connections, args.port))
+    while len(results) < args.connections:
+        phase = 'full' if len(results) < args.connections // 2 else 'resume'
+        context = new_context(args.cert, args.key) if phase == 'full' else shared
+        conn, address = server.accept()
+        accepted = time.monotonic()
+        try:
+            conn.settimeout(args.timeout)
+            tls = context.wrap_socket(conn, server_side=True)
+            handshake_ms = (time.monotonic() - accepted) * 1000
+            sent = time.monotonic()
+            tls.sendall(QUERY)
+            reply = tls.recv(16)
+            query_ms = (time.monotonic() - sent) * 1000
+            results.append({
+                'phase': phase,
+                'reused': tls.session_reused,
+                'handshake_ms': round(handshake_ms, 1),
+                'query_ms': round(query_ms, 1),
+                'reply': reply[:1].decode(errors='replace'),
+            })
+            print('{} handshake from {} in {:.1f} ms, query {:.1f} ms'.format(
+                'Resumed' if tls.session_reused else 'Full', address[0], handshake_ms, query_ms))
+            tls.close()
+        except (ssl.SSLError, socket.error) as e:
+            print('Connection from {} failed: {}'.format(address[0], e))
+            conn.close()
+    server.close()
+    return results
+
+
+def attach_device_log(results, path):
+    '''Pairs the n-th handshake line of the device log with the n-th connection.'''
+    with open(path, errors='replace') as f:
+        lines = [DEVICE_LINE.search(line) for line in f]
+    matches = [m for m in lines if m][-len(results):]
+    if len(matches) != len(results):
+        print('Device log has {} handshakes for {} connections, ignoring it'.format(
+            len(matches), len(results)), file=sys.stderr)
+        return
+    for result, match in zip(results, matches):
+        result['device_ms'] = int(match.group(1))
+        result['heap_peak'] = int(match.group(3))
+        result['heap_kept'] = int(match.group(4))
+        result['stack_free'] = int(match.group(5))
+
+
+def report(results):
+    summary = {}
+    for kind, reused in (('full', False), ('resumed', True)):
+        runs = [r for r in results if r['reused'] == reused]
+        summary[kind] = {
+            metric: summarize([r[metric] for r in runs if metric in r])
+            for metric in ('handshake_ms', 'query_ms', 'device_ms', 'heap_peak', 'stack_free')
+        }
+    return {'connections': results, 'summary': summary}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=USAGE, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--cert', required=True, help='server certificate (PEM)')
+    parser.add_argument('--key', required=True, help='server private key (PEM)')
+    parser.add_argument('--port', type=int, default=PORT)
+    parser.add_argument('--connections', type=int, default=20, help='handshakes to measure')
+    parser.add_argument('--timeout', type=float, default=30.0, help='seconds to wait for the ESP32')
+    parser.add_argument('--log', help='device log captured during the run')
+    parser.add_argument('--output', help='write the JSON report here instead of stdout')
+    args = parser.parse_args()
+
+    results = serve(args)
+    if args.log:
+        attach_device_log(results, args.log)
+    text = json.dumps(report(results), indent=2)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text + '\n')
+    else:
+        print(text)
+
+
+if __name__ == '__main__':
+    main()
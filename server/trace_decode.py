@@ -0,0 +1,82 @@
+'''MIT License
+
+Copyright (c) 2021 Lucas Orsi (lorsi 96) 
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+'''
+
+import struct
+import sys
+
+SECTOR_SIZE = 4096
+MAGIC = 0x544D4450
+HEADER = struct.Struct('<IIHHI')
+RECORD = struct.Struct('<IBBHBBBBI')
+FLAG_MATCHED = 0x01
+FLAG_REJECTED = 0x02
+
+SOURCES = {0: 'NONE', 1: 'WIFI', 2: 'BT', 3: 'UDP'}
+STATES = {0: 'SLOW_BLINK', 1: 'FAST_BLINK', 2: 'BT_DISABLED'}
+
+
+def read_sectors(image):
+    '''Yields (sequence, records) for every flushed sector, oldest first.'''
+    sectors = []
+    for offset in range(0, len(image) - HEADER.size + 1, SECTOR_SIZE):
+        magic, sequence, count, record_size, _ = HEADER.unpack_from(image, offset)
+        if magic != MAGIC or record_size != RECORD.size:
+            continue
+        records = [RECORD.unpack_from(image, offset + HEADER.size + i * RECORD.size) for i in range(count)]
+        sectors.append((sequence, records))
+    return sorted(sectors)
+
+
+def decode(path):
+    with open(path, 'rb') as f:
+        image = f.read()
+    durations = []
+    last_states = {}  # Per instance.
+    for sequence, records in read_sectors(image):
+        print('--- sector sequence {} ({} records)'.format(sequence, len(records)))
+        for timestamp, data, instance, handler_us, source, prev_state, next_state, flags, peer in records:
+            if flags & FLAG_REJECTED:
+                print('{:>10} ms {:>4}:{:<5} {:>5} #{:<3} rejected, no such instance'.format(
+                    timestamp, SOURCES.get(source, source), peer, data, instance))
+                continue
+            last_state = last_states.get(instance)
+            if last_state is not None and prev_state != last_state:
+                print('!!! discontinuity on #{}: expected {} got {}'.format(
+                    instance, STATES.get(last_state), STATES.get(prev_state)))
+            last_states[instance] = next_state
+            durations.append(handler_us)
+            print('{:>10} ms {:>4}:{:<5} {:>5} #{:<3} {:>11} -> {:<11} {:>5} us{}'.format(
+                timestamp, SOURCES.get(source, source), peer, data, instance, STATES.get(prev_state, prev_state),
+                STATES.get(next_state, next_state), handler_us, '' if flags & FLAG_MATCHED else ' (unmatched)'))
+    if durations:
+        durations.sort()
+        pick = lambda p: durations[min(len(durations) - 1, int(len(durations) * p))]
+        print('{} dispatches, handler us p50={} p99={} max={}'.format(
+            len(durations), pick(0.5), pick(0.99), durations[-1]))
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 2:
+        print('Usage: {} <trace partition dump>'.format(sys.argv[0]))
+        exit(1)
+    decode(sys.argv[1])
@@ -0,0 +1,75 @@
+'''MIT License
+
+Copyright (c) 2021 Lucas Orsi (lorsi 96) 
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+'''
+
+import socket
+import struct
+import sys
+import time
+
+PORT = 3334
+MAGIC = b'P'
+TIMEOUT_S = 0.5
+RETRIES = 3
+
+DECODERS = {
+    0: {0: 'Blinking Slowly', 1: 'Blinking Fast', 2: 'Not Blinking'},
+    1: {0: 'Listening to BT events', 1: 'Not listening to BT events'},
+}
+
+
+def query(sock, address, seq, cmd):
+    '''Sends a status query and waits for the matching response.
+
+    Returns (value, round trip in ms) or None if nothing came back.
+    '''
+    request = MAGIC + struct.pack('>HB', seq, cmd)
+    for _ in range(RETRIES):
+        start = time.monotonic()
+        sock.sendto(request, address)
+        deadline = start + TIMEOUT_S
+        while time.monotonic() < deadline:
+            sock.settimeout(deadline - time.monotonic())
+            try:
+                data, _ = sock.recvfrom(16)
+            except socket.timeout:
+                break
+            if len(data) == 5 and data[:1] == MAGIC and struct.unpack('>HB', data[1:4]) == (seq, cmd):
+                return data[4], (time.monotonic() - start) * 1000
+    return None
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print('Usage: {} <board ip> [<board ip> ...]'.format(sys.argv[0]))
+        exit(1)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    seq = 0
+    for host in sys.argv[1:]:
+        for cmd in DECODERS:
+            seq = (seq + 1) & 0xFFFF
+            result = query(sock, (host, PORT), seq, cmd)
+            if result is None:
+                print('{}: no answer to query {}'.format(host, cmd))
+                continue
+            value, rtt = result
+            print('{}: {} ({:.1f} ms)'.format(host, DECODERS[cmd].get(value, value), rtt))
@@ -0,0 +1,168 @@
+/**
+ * @brief Admission stress test: one BT client floods the board while
+ *        well-behaved TCP and UDP clients keep querying it.
+ *
+ * Usage: bench_admission [passes]
+ *
+ * The run has a quiet half and a flooded half, 100 ms apart in virtual
+ * time as on the board. Well-behaved clients send one query per pass
+ * each; in the flooded half a BT client also fills the BT RX queue every
+ * pass, with blink speed queries and, now and then, a speed toggle.
+ * Every value carries its own peer so replies can be matched to it.
+ *
+ * Checks that the well-behaved clients are answered within a pass or two
+ * however hard the flood, that the flood is held to the BT rules, and
+ * that each query coalesced above the rate gets the speed the LED had
+ * when its leader was dispatched. Prints one JSON object with the
+ * latency percentiles of both halves and the BT admission counters.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "host_stubs.h"
+#include "app_fsm.h"
+#include "admission.h"
+#include "transport.h"
+#include "loopback_transport.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define PDM_BENCH_LOOP_MS 100
+#define PDM_BENCH_TOGGLE_EVERY 4     /**< Flood values between speed toggles.*/
+#define PDM_BENCH_BT_QUERY 2
+#define PDM_BENCH_MAX_LATENCY_MS (2 * PDM_BENCH_LOOP_MS)
+
+typedef enum {
+    PDM_BENCH_QUIET,
+    PDM_BENCH_FLOOD,
+    PDM_BENCH_HALVES,
+} PDM_BenchHalf_t;
+
+typedef struct {
+    int64_t sentUs;
+    PDM_DataSource_t source;
+    uint8_t command;
+    PDM_BenchHalf_t half;
+    bool answered;
+} PDM_BenchRequest_t;
+
+static PDM_Loopback_t loopbacks[PDM_SOURCE_COUNT];
+static PDM_BenchRequest_t *requests; /**< By peer.*/
+static uint32_t nextPeer = 0;
+static double *latenciesMs[PDM_BENCH_HALVES];
+static size_t replies[PDM_BENCH_HALVES];
+static size_t floodQueryReplies = 0;
+static uint32_t btSpeed;             /**< Speed the LED has, as far as BT replies tell.*/
+
+static bool PDMBench_inject_(const PDM_DataSource_t source, const uint8_t command, const PDM_BenchHalf_t half) {
+    requests[nextPeer] = (PDM_BenchRequest_t){esp_timer_get_time(), source, command, half, false};
+    if (!PDMLoopback_inject(&loopbacks[source], nextPeer, command)) {
+        return false;
+    }
+    nextPeer++;
+    return true;
+}
+
+static void PDMBench_collect_() {
+    for (PDM_DataSource_t source = PDM_WIFI; source < PDM_SOURCE_COUNT; source++) {
+        uint32_t peer, value;
+        while (PDMLoopback_take(&loopbacks[source], &peer, &value)) {
+            PDM_CHECK(peer < nextPeer && !requests[peer].answered, "reply to unknown peer %u", peer);
+            PDM_BenchRequest_t *request = &requests[peer];
+            request->answered = true;
+            PDM_CHECK(value != PDM_BUSY_REPLY, "%s client told to retry", loopbacks[source].transport.name);
+            if (source != PDM_BT) {
+                latenciesMs[request->half][replies[request->half]++] = (esp_timer_get_time() - request->sentUs) / 1000.0;
+                continue;
+            }
+            // BT replies are sent in dispatch order: a query reports the speed of the last toggle before it.
+            if (request->command == PDM_BENCH_BT_QUERY) {
+                PDM_CHECK(value == btSpeed, "query answered %u, LED at %u", value, btSpeed);
+                floodQueryReplies++;
+            } else {
+                btSpeed = value;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const size_t passes = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    const size_t maxRequests = passes * (PDM_TRANSPORT_QUEUE_LEN + 2) + 1;
+    requests = calloc(maxRequests, sizeof(PDM_BenchRequest_t));
+    double *passUs = calloc(passes, sizeof(double));
+    for (PDM_BenchHalf_t half = PDM_BENCH_QUIET; half < PDM_BENCH_HALVES; half++) {
+        latenciesMs[half] = calloc(passes * 2, sizeof(double));
+        PDM_CHECK(latenciesMs[half] != NULL, "out of memory");
+    }
+    PDM_CHECK(requests != NULL && passUs != NULL, "out of memory");
+
+    PDMHost_useRealTime(false);
+    static const char *names[PDM_SOURCE_COUNT] = {"none", "tcp", "bt", "udp"};
+    for (PDM_DataSource_t source = PDM_WIFI; source < PDM_SOURCE_COUNT; source++) {
+        PDMLoopback_create(&loopbacks[source], names[source]);
+        PDMTransport_register(PDMLoopback_transport(&loopbacks[source]), source);
+    }
+    PDMApp_init();
+
+    // Start listening to BT, which starts blinking fast.
+    PDMBench_inject_(PDM_WIFI, 2, PDM_BENCH_QUIET);
+    PDMApp_loop();
+    vTaskDelay(pdMS_TO_TICKS(PDM_BENCH_LOOP_MS));
+    PDMApp_loop();
+    PDMBench_collect_();
+    btSpeed = PDMFsm_state(PDMApp_fsm(), 0);
+    PDM_CHECK(btSpeed == FAST_BLINK, "BT not enabled");
+    const PDM_AdmissionStats_t quietBt = *PDMAdmission_stats(PDM_BT);
+
+    size_t floodValues = 0;
+    for (size_t pass = 0; pass < passes; pass++) {
+        const PDM_BenchHalf_t half = pass < passes / 2 ? PDM_BENCH_QUIET : PDM_BENCH_FLOOD;
+        PDM_CHECK(PDMBench_inject_(PDM_WIFI, pass % 2, half), "TCP RX queue full");
+        PDM_CHECK(PDMBench_inject_(PDM_UDP, pass % 2, half), "UDP RX queue full");
+        while (half == PDM_BENCH_FLOOD && PDMTransport_rxSpace(PDMLoopback_transport(&loopbacks[PDM_BT])) > 0) {
+            const bool toggles = floodValues % PDM_BENCH_TOGGLE_EVERY == 0;
+            PDMBench_inject_(PDM_BT, toggles ? floodValues / PDM_BENCH_TOGGLE_EVERY % 2 : PDM_BENCH_BT_QUERY, half);
+            floodValues++;
+        }
+        const int64_t startUs = PDMTest_hostUs();
+        PDMApp_loop();
+        passUs[pass] = PDMTest_hostUs() - startUs;
+        PDMBench_collect_();
+        vTaskDelay(pdMS_TO_TICKS(PDM_BENCH_LOOP_MS));
+    }
+    for (uint8_t i = 0; i < 2; i++) { // Last replies go out on the next pass.
+        PDMApp_loop();
+        PDMBench_collect_();
+    }
+
+    for (uint32_t peer = 0; peer < nextPeer; peer++) {
+        PDM_CHECK(requests[peer].answered || requests[peer].source == PDM_BT,
+                  "%s query %u unanswered", loopbacks[requests[peer].source].transport.name, peer);
+    }
+    const size_t floodPasses = passes - passes / 2;
+    const PDM_AdmissionStats_t *bt = PDMAdmission_stats(PDM_BT);
+    const uint32_t admitted = bt->admitted - quietBt.admitted;
+    // Queries: a token per pass and a burst of 5. Toggles: one every 5 passes and a burst of 3.
+    PDM_CHECK(admitted <= floodPasses + floodPasses / 5 + 5 + 3, "%u BT values admitted in %zu passes", admitted, floodPasses);
+    PDM_CHECK(bt->dropped > 0 && bt->coalesced > 0, "flood neither dropped nor coalesced");
+    PDM_CHECK(floodQueryReplies > admitted, "coalesced queries went unanswered");
+
+    const double quietP99 = PDMTest_percentile(latenciesMs[PDM_BENCH_QUIET], replies[PDM_BENCH_QUIET], 99);
+    const double floodP99 = PDMTest_percentile(latenciesMs[PDM_BENCH_FLOOD], replies[PDM_BENCH_FLOOD], 99);
+    const double floodMax = PDMTest_percentile(latenciesMs[PDM_BENCH_FLOOD], replies[PDM_BENCH_FLOOD], 100);
+    PDM_CHECK(floodMax <= PDM_BENCH_MAX_LATENCY_MS, "well-behaved clients waited %.0f ms", floodMax);
+
+    printf("{\"bench\":\"admission\",\"passes\":%zu,\"flood_values\":%zu,"
+           "\"quiet_latency_ms_p50\":%.1f,\"quiet_latency_ms_p99\":%.1f,"
+           "\"flood_latency_ms_p50\":%.1f,\"flood_latency_ms_p99\":%.1f,\"flood_latency_ms_max\":%.1f,"
+           "\"bt_admitted\":%u,\"bt_coalesced\":%u,\"bt_dropped\":%u,\"bt_query_replies\":%zu,"
+           "\"pass_us_p50\":%.2f,\"pass_us_p99\":%.2f}\n",
+           passes, floodValues,
+           PDMTest_percentile(latenciesMs[PDM_BENCH_QUIET], replies[PDM_BENCH_QUIET], 50), quietP99,
+           PDMTest_percentile(latenciesMs[PDM_BENCH_FLOOD], replies[PDM_BENCH_FLOOD], 50), floodP99, floodMax,
+           admitted, bt->coalesced - quietBt.coalesced, bt->dropped - quietBt.dropped, floodQueryReplies,
+           PDMTest_percentile(passUs, passes, 50), PDMTest_percentile(passUs, passes, 99));
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * @brief Benchmark of the dispatch path: transports, admission, FSM,
+ *        handlers and replies, with loopbacks standing in for TCP, BT
+ *        and UDP.
+ * 
+ * Usage: bench_dispatch [passes]
+ * 
+ * Every main loop pass gets a mix of UDP and TCP queries and, now and
+ * then, a BT speed toggle. Passes are 100 ms apart in virtual time, as
+ * on the board. Prints one JSON object: host CPU time per pass, events
+ * per CPU second, and the latency from arrival to reply in virtual ms.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "host_stubs.h"
+#include "app_fsm.h"
+#include "transport.h"
+#include "loopback_transport.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define PDM_BENCH_LOOP_MS 100
+#define PDM_BENCH_UDP_PER_PASS 6
+#define PDM_BENCH_BT_EVERY 5 /**< Passes between BT toggles, within the BT control rate.*/
+
+static PDM_Loopback_t loopbacks[PDM_SOURCE_COUNT];
+static int64_t *sentUs;      /**< Virtual time each event was injected, by peer.*/
+static double *latenciesMs;
+static size_t replies = 0;
+
+static void PDMBench_inject_(const PDM_DataSource_t source, const uint32_t peer, const uint32_t value) {
+    sentUs[peer] = esp_timer_get_time();
+    PDM_CHECK(PDMLoopback_inject(&loopbacks[source], peer, value), "%s RX queue full",
+              loopbacks[source].transport.name);
+}
+
+static void PDMBench_collect_() {
+    for (PDM_DataSource_t source = PDM_WIFI; source < PDM_SOURCE_COUNT; source++) {
+        uint32_t peer, value;
+        while (PDMLoopback_take(&loopbacks[source], &peer, &value)) {
+            latenciesMs[replies++] = (esp_timer_get_time() - sentUs[peer]) / 1000.0;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const size_t passes = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000;
+    const size_t maxEvents = passes * (PDM_BENCH_UDP_PER_PASS + 2) + 1;
+    sentUs = calloc(maxEvents, sizeof(int64_t));
+    latenciesMs = calloc(maxEvents, sizeof(double));
+    double *passUs = calloc(passes + 2, sizeof(double));
+    PDM_CHECK(sentUs != NULL && latenciesMs != NULL && passUs != NULL, "out of memory");
+
+    PDMHost_useRealTime(false);
+    static const char *names[PDM_SOURCE_COUNT] = {"none", "tcp", "bt", "udp"};
+    for (PDM_DataSource_t source = PDM_WIFI; source < PDM_SOURCE_COUNT; source++) {
+        PDMLoopback_create(&loopbacks[source], names[source]);
+        PDMTransport_register(PDMLoopback_transport(&loopbacks[source]), source);
+    }
+    PDMApp_init();
+
+    uint32_t nextPeer = 0;
+    size_t events = 0;
+    PDMBench_inject_(PDM_WIFI, nextPeer++, 2); // Start listening to BT.
+    events++;
+    int64_t busyUs = 0;
+    for (size_t pass = 0; pass < passes + 2; pass++) {
+        if (pass < passes) {
+            for (uint8_t i = 0; i < PDM_BENCH_UDP_PER_PASS; i++) {
+                PDMBench_inject_(PDM_UDP, nextPeer++, i % 2);
+            }
+            PDMBench_inject_(PDM_WIFI, nextPeer++, pass % 2);
+            events += PDM_BENCH_UDP_PER_PASS + 1;
+            if (pass % PDM_BENCH_BT_EVERY == 0) {
+                const PDM_FsmState_t state = PDMFsm_state(PDMApp_fsm(), 0);
+                PDMBench_inject_(PDM_BT, nextPeer++, state == SLOW_BLINK ? 0 : 1);
+                events++;
+            }
+        }
+        const int64_t startUs = PDMTest_hostUs();
+        PDMApp_loop();
+        passUs[pass] = PDMTest_hostUs() - startUs;
+        busyUs += passUs[pass];
+        PDMBench_collect_();
+        vTaskDelay(pdMS_TO_TICKS(PDM_BENCH_LOOP_MS));
+    }
+    PDM_CHECK(replies == events, "%zu replies to %zu events", replies, events);
+
+    printf("{\"bench\":\"dispatch\",\"passes\":%zu,\"events\":%zu,\"replies\":%zu,"
+           "\"events_per_cpu_s\":%.0f,\"pass_us_p50\":%.2f,\"pass_us_p99\":%.2f,\"pass_us_max\":%.2f,"
+           "\"latency_ms_p50\":%.1f,\"latency_ms_p99\":%.1f,\"latency_ms_max\":%.1f}\n",
+           passes, events, replies, events / (busyUs / 1e6),
+           PDMTest_percentile(passUs, passes + 2, 50), PDMTest_percentile(passUs, passes + 2, 99),
+           PDMTest_percentile(passUs, passes + 2, 100),
+           PDMTest_percentile(latenciesMs, replies, 50), PDMTest_percentile(latenciesMs, replies, 99),
+           PDMTest_percentile(latenciesMs, replies, 100));
+    return 0;
+}
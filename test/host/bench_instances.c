@@ -0,0 +1,114 @@
+/**
+ * @brief Benchmark of the FSM engine with hundreds of instances running
+ *        the application table.
+ *
+ * Usage: bench_instances [events]
+ *
+ * For each instance count, events from TCP and BT are spread over the
+ * instances and dispatched in batches the size of a transport queue,
+ * one in 64 of them for an instance that doesn't exist. Replies go to
+ * sink transports. Checks that every event for a missing instance is
+ * rejected and that the cost per event stays flat as instances are
+ * added. Prints one JSON object with the dispatch time per event and the
+ * state memory of every instance count.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "app_fsm.h"
+#include "fsm.h"
+#include "transport.h"
+
+#define PDM_BENCH_REJECT_EVERY 64
+#define PDM_BENCH_MAX_SLOWDOWN 8 /**< Largest count against one instance, on the median. Loose: hosts are noisy.*/
+
+static const uint16_t instanceCounts_[] = {1, 16, 256, 1024, 4096};
+#define PDM_BENCH_RUNS (sizeof(instanceCounts_) / sizeof(instanceCounts_[0]))
+
+static size_t rejected = 0;
+
+static void PDMBench_observe_(const PDM_FsmDispatch_t *dispatch) {
+    rejected += dispatch->rejected;
+}
+
+static bool PDMBench_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value) {
+    return true;
+}
+
+static const PDM_TransportOps_t sinkOps = {
+    .init = NULL,
+    .poll = NULL,
+    .send = PDMBench_send_,
+};
+
+static PDM_Transport_t sinks[PDM_SOURCE_COUNT];
+
+static int64_t PDMBench_hostNs_() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    const size_t events = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    const size_t batches = events / PDM_TRANSPORT_QUEUE_LEN;
+    double *batchNs = calloc(batches + 1, sizeof(double));
+    PDM_CHECK(batches > 0 && batchNs != NULL, "out of memory");
+    for (PDM_TransportId_t id = PDM_WIFI; id < PDM_SOURCE_COUNT; id++) {
+        sinks[id].name = "sink";
+        sinks[id].ops = &sinkOps;
+        PDMTransport_register(&sinks[id], id);
+    }
+    size_t tableLen;
+    const PDM_FsmEntry_t *table = PDMApp_table(&tableLen);
+
+    double p50Ns[PDM_BENCH_RUNS];
+    printf("{\"bench\":\"instances\",\"events\":%zu,\"runs\":[", batches * PDM_TRANSPORT_QUEUE_LEN);
+    for (size_t run = 0; run < PDM_BENCH_RUNS; run++) {
+        const uint16_t instanceCount = instanceCounts_[run];
+        PDM_FsmState_t *states = malloc(instanceCount * sizeof(PDM_FsmState_t));
+        PDM_CHECK(states != NULL, "out of memory");
+        PDM_Fsm_t fsm;
+        PDMFsm_init(&fsm, table, tableLen, states, instanceCount, BT_DISABLED, PDMBench_observe_);
+        rejected = 0;
+
+        // Same pseudo-random sequence for every count: queries, BT enable/disable and speed toggles.
+        uint32_t seed = 0x12345678;
+        size_t outOfRange = 0;
+        for (size_t b = 0; b < batches; b++) {
+            PDM_FsmEvent_t batch[PDM_TRANSPORT_QUEUE_LEN];
+            for (uint8_t i = 0; i < PDM_TRANSPORT_QUEUE_LEN; i++) {
+                seed = seed * 1103515245 + 12345;
+                const size_t n = b * PDM_TRANSPORT_QUEUE_LEN + i;
+                const bool isMissing = n % PDM_BENCH_REJECT_EVERY == PDM_BENCH_REJECT_EVERY - 1;
+                batch[i] = (PDM_FsmEvent_t){
+                    .source = (seed >> 8) % 2 ? PDM_BT : PDM_WIFI,
+                    .data = (seed >> 12) % 3,
+                    .peer = 1,
+                    .instance = isMissing ? instanceCount : (seed >> 16) % instanceCount,
+                };
+                outOfRange += isMissing;
+            }
+            const int64_t startNs = PDMBench_hostNs_();
+            PDMFsm_dispatch(&fsm, batch, PDM_TRANSPORT_QUEUE_LEN);
+            batchNs[b] = PDMBench_hostNs_() - startNs;
+            PDMTransport_task(); // Sends the replies, so the TX queues never fill.
+        }
+        PDM_CHECK(rejected == outOfRange, "%zu of %zu events for a missing instance rejected", rejected, outOfRange);
+        for (uint16_t i = 0; i < instanceCount; i++) {
+            PDM_CHECK(states[i] <= BT_DISABLED, "instance %u in state %u", i, states[i]);
+        }
+
+        p50Ns[run] = PDMTest_percentile(batchNs, batches, 50) / PDM_TRANSPORT_QUEUE_LEN;
+        printf("%s{\"instances\":%u,\"state_bytes\":%zu,\"rejected\":%zu,"
+               "\"ns_per_event_p50\":%.1f,\"ns_per_event_p99\":%.1f}",
+               run > 0 ? "," : "", instanceCount, instanceCount * sizeof(PDM_FsmState_t), rejected,
+               p50Ns[run], PDMTest_percentile(batchNs, batches, 99) / PDM_TRANSPORT_QUEUE_LEN);
+        free(states);
+    }
+    printf("]}\n");
+    PDM_CHECK(p50Ns[PDM_BENCH_RUNS - 1] <= p50Ns[0] * PDM_BENCH_MAX_SLOWDOWN + 1,
+              "%.1f ns per event with %u instances, %.1f with one", p50Ns[PDM_BENCH_RUNS - 1],
+              instanceCounts_[PDM_BENCH_RUNS - 1], p50Ns[0]);
+    return 0;
+}
@@ -0,0 +1,465 @@
+/**
+ * @brief Host benchmark suite: the board's main loop under the traffic of
+ *        real clients, over host sockets and the SPP stand-in.
+ *
+ * Usage: bench_suite [results.json] [passes]
+ *
+ * The board runs as in application.c: BT, TCP and UDP transports, the
+ * perf_stats calls around each pass and 100 ms between passes, in virtual
+ * time. The suite is the other end of every link: a TCP server on any
+ * free port (handed to the board through NVS), a UDP client and two BT
+ * peers connected through PDMHost_btConnect. Each workload runs in its
+ * own thread on a painted stack, for the given number of passes:
+ *
+ *  - idle: no traffic, the LED keeps blinking.
+ *  - burst: pipelined TCP queries, UDP and BT bursts every few passes,
+ *    above the admission rate but never above what coalescing answers.
+ *  - mixed: steady TCP and UDP queries, one BT peer querying and the
+ *    other toggling the blink speed.
+ *  - reconnect_storm: the server drops the TCP connection and one BT peer
+ *    leaves and comes back, over and over, while both keep querying.
+ *
+ * Every request is matched to its reply (FIFO per TCP connection and BT
+ * peer, sequence number for UDP). Latencies are in virtual time, so they
+ * are the same on every host; loop time and duty cycle are host time and
+ * only indicative. Prints one JSON object and writes it to results.json,
+ * which perf_report.py compares against test/host/baseline.json.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include "host_test.h"
+#include "host_stubs.h"
+#include "app_fsm.h"
+#include "admission.h"
+#include "transport.h"
+#include "tcp_client.h"
+#include "bluetooth_client.h"
+#include "udp_status.h"
+#include "led_blinker.h"
+#include "perf_stats.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define PDM_SUITE_LOOP_MS 100
+#define PDM_SUITE_PENDING 64            /**< Requests in flight per link.*/
+#define PDM_SUITE_STACK_LEN (256 * 1024)
+#define PDM_SUITE_STACK_PAINT 0xA5
+#define PDM_SUITE_BURST_EVERY 10        /**< Passes between bursts.*/
+#define PDM_SUITE_TCP_BURST 16
+#define PDM_SUITE_BT_BURST 8
+#define PDM_SUITE_TOGGLE_EVERY 10       /**< Passes between BT speed toggles, under the 500 ms rule.*/
+#define PDM_SUITE_TCP_DROP_EVERY 20     /**< Passes between TCP disconnects in the storm.*/
+#define PDM_SUITE_BT_DROP_EVERY 10      /**< Passes between BT reconnects in the storm.*/
+#define PDM_SUITE_BT_QUERY 2
+
+typedef struct {
+    int64_t sentUs[PDM_SUITE_PENDING];
+    uint8_t head;
+    uint8_t count;
+} PDM_SuiteFifo_t;
+
+typedef struct {
+    esp_bd_addr_t bda;
+    uint32_t handle;
+    PDM_SuiteFifo_t fifo;
+} PDM_SuitePeer_t;
+
+typedef struct PDM_SuiteWorkload PDM_SuiteWorkload_t;
+struct PDM_SuiteWorkload {
+    const char *name;
+    void (*step)(PDM_SuiteWorkload_t *workload, const size_t pass); /**< Traffic sent before a pass.*/
+    size_t passes;
+    size_t sent;
+    size_t replies;
+    double *latenciesMs;
+    double *loopUs;
+    int64_t loopUsTotal;
+    size_t busyPasses;
+    size_t events;
+    uint32_t tcpReconnects;
+    uint32_t btReconnects;
+    double reconnectMsMax;      /**< Longest from a TCP drop to the first reply on the new connection.*/
+    uint32_t ledEdges;
+    size_t heapPeak;
+    size_t stackUsed;
+};
+
+static int listener = -1;
+static int tcpSock = -1;        /**< Server end of the board's connection.*/
+static int64_t tcpClosedUs = -1; /**< When the server dropped the connection, -1 once answered again.*/
+static PDM_SuiteFifo_t tcpFifo;
+static int udpSock = -1;
+static uint16_t udpSeq = 0;
+static int64_t udpSentUs[UINT16_MAX + 1]; /**< By sequence number, -1 once answered.*/
+static PDM_SuitePeer_t peers[PDM_BT_MAX_SESSIONS] = {
+    {.bda = {0x10, 0x00, 0x00, 0x00, 0x00, 0x01}},
+    {.bda = {0x10, 0x00, 0x00, 0x00, 0x00, 0x02}},
+};
+static PDM_SuiteWorkload_t *current;
+
+/** Links *****************************************/
+static void PDMSuite_push_(PDM_SuiteFifo_t *fifo) {
+    PDM_CHECK(fifo->count < PDM_SUITE_PENDING, "%u requests in flight", fifo->count);
+    fifo->sentUs[(fifo->head + fifo->count++) % PDM_SUITE_PENDING] = esp_timer_get_time();
+    current->sent++;
+}
+
+static void PDMSuite_answer_(const int64_t sentUs, const char reply) {
+    PDM_CHECK(reply >= '0' + SLOW_BLINK && reply <= '0' + BT_DISABLED, "reply '%c'", reply);
+    PDM_CHECK(current->replies < current->sent, "more replies than requests");
+    current->latenciesMs[current->replies++] = (esp_timer_get_time() - sentUs) / 1000.0;
+}
+
+static void PDMSuite_pop_(PDM_SuiteFifo_t *fifo, const char reply) {
+    PDM_CHECK(fifo->count > 0, "reply '%c' to no request", reply);
+    const int64_t sentUs = fifo->sentUs[fifo->head];
+    fifo->head = (fifo->head + 1) % PDM_SUITE_PENDING;
+    fifo->count--;
+    PDMSuite_answer_(sentUs, reply);
+}
+
+static void PDMSuite_tcpAccept_() {
+    if (tcpSock >= 0) {
+        return;
+    }
+    tcpSock = accept(listener, NULL, NULL);
+    if (tcpSock < 0) {
+        return; // The board reconnects on its next pass.
+    }
+    fcntl(tcpSock, F_SETFL, O_NONBLOCK);
+    const int noDelay = 1; // Virtual time runs faster than delayed ACKs: nothing may wait for one.
+    setsockopt(tcpSock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    current->tcpReconnects += tcpClosedUs >= 0;
+}
+
+static void PDMSuite_tcpSend_(const char *commands) {
+    if (tcpSock < 0) {
+        return;
+    }
+    const size_t len = strlen(commands);
+    PDM_CHECK(send(tcpSock, commands, len, 0) == (ssize_t)len, "errno %d", errno);
+    for (size_t i = 0; i < len; i++) {
+        PDMSuite_push_(&tcpFifo);
+    }
+}
+
+/** Drops the connection once every request on it is answered. */
+static void PDMSuite_tcpDrop_() {
+    if (tcpSock >= 0 && tcpFifo.count == 0) {
+        close(tcpSock);
+        tcpSock = -1;
+        tcpClosedUs = esp_timer_get_time();
+    }
+}
+
+static void PDMSuite_udpSend_(const uint8_t command) {
+    const uint8_t request[PDM_UDP_REQUEST_LEN] = {PDM_UDP_MAGIC, udpSeq >> 8, udpSeq & 0xFF, command};
+    PDM_CHECK(send(udpSock, request, sizeof(request), 0) == sizeof(request), "errno %d", errno);
+    udpSentUs[udpSeq++] = esp_timer_get_time();
+    current->sent++;
+}
+
+static void PDMSuite_btSend_(PDM_SuitePeer_t *peer, const uint8_t command) {
+    const char data = '0' + command;
+    if (peer->handle != 0 && PDMHost_btReceive(peer->handle, &data, 1)) {
+        PDMSuite_push_(&peer->fifo);
+    }
+}
+
+/** Leaves once every request of the peer is answered. */
+static void PDMSuite_btDrop_(PDM_SuitePeer_t *peer) {
+    if (peer->handle != 0 && peer->fifo.count == 0) {
+        PDMHost_btDisconnect(peer->handle);
+        peer->handle = 0;
+    }
+}
+
+static void PDMSuite_btConnect_(PDM_SuitePeer_t *peer) {
+    if (peer->handle == 0) {
+        peer->handle = PDMHost_btConnect(peer->bda);
+        PDM_CHECK(peer->handle != 0, "BT peer %u turned away", peer->bda[5]);
+        current->btReconnects += current->passes > 0;
+    }
+}
+
+static void PDMSuite_collect_() {
+    char replies[PDM_SUITE_PENDING];
+    ssize_t got;
+    while (tcpSock >= 0 && (got = recv(tcpSock, replies, sizeof(replies), 0)) > 0) {
+        if (tcpClosedUs >= 0) {
+            const double reconnectMs = (esp_timer_get_time() - tcpClosedUs) / 1000.0;
+            current->reconnectMsMax = reconnectMs > current->reconnectMsMax ? reconnectMs : current->reconnectMsMax;
+            tcpClosedUs = -1;
+        }
+        for (ssize_t i = 0; i < got; i++) {
+            PDMSuite_pop_(&tcpFifo, replies[i]);
+        }
+    }
+    PDM_CHECK(tcpSock < 0 || got != 0, "board closed the connection");
+    uint8_t reply[PDM_UDP_RESPONSE_LEN];
+    while (recv(udpSock, reply, sizeof(reply), 0) == PDM_UDP_RESPONSE_LEN) {
+        const uint16_t seq = reply[1] << 8 | reply[2];
+        PDM_CHECK(reply[0] == PDM_UDP_MAGIC && udpSentUs[seq] >= 0, "UDP reply to no request");
+        PDMSuite_answer_(udpSentUs[seq], '0' + reply[4]);
+        udpSentUs[seq] = -1;
+    }
+    for (uint8_t i = 0; i < PDM_BT_MAX_SESSIONS; i++) {
+        size_t len;
+        while (peers[i].handle != 0 && (len = PDMHost_btTake(peers[i].handle, (uint8_t *)replies, sizeof(replies))) > 0) {
+            for (size_t j = 0; j < len; j++) {
+                PDMSuite_pop_(&peers[i].fifo, replies[j]);
+            }
+        }
+    }
+}
+
+/** Workloads *************************************/
+static void PDMSuite_idle_(PDM_SuiteWorkload_t *workload, const size_t pass) {
+}
+
+static void PDMSuite_burst_(PDM_SuiteWorkload_t *workload, const size_t pass) {
+    if (pass % PDM_SUITE_BURST_EVERY != 0) {
+        return;
+    }
+    // One segment of identical queries: what doesn't get a token coalesces with the first.
+    char segment[PDM_SUITE_TCP_BURST + 1] = {0};
+    memset(segment, '0', PDM_SUITE_TCP_BURST);
+    PDMSuite_tcpSend_(segment);
+    for (uint8_t i = 0; i < PDM_TRANSPORT_QUEUE_LEN; i++) {
+        PDMSuite_udpSend_(i % 2);
+    }
+    for (uint8_t i = 0; i < PDM_SUITE_BT_BURST; i++) {
+        PDMSuite_btSend_(&peers[pass / PDM_SUITE_BURST_EVERY % PDM_BT_MAX_SESSIONS], PDM_SUITE_BT_QUERY);
+    }
+}
+
+static void PDMSuite_mixed_(PDM_SuiteWorkload_t *workload, const size_t pass) {
+    PDMSuite_udpSend_(pass % 2);
+    if (pass % 2 == 0) {
+        PDMSuite_tcpSend_(pass % 4 == 0 ? "0" : "1");
+    }
+    if (pass % 3 == 0) {
+        PDMSuite_btSend_(&peers[0], PDM_SUITE_BT_QUERY);
+    }
+    if (pass % PDM_SUITE_TOGGLE_EVERY == 0) {
+        // A toggle's code is the speed it leaves: 0 from slow, 1 from fast.
+        PDMSuite_btSend_(&peers[1], PDMFsm_state(PDMApp_fsm(), 0));
+    }
+}
+
+static void PDMSuite_storm_(PDM_SuiteWorkload_t *workload, const size_t pass) {
+    const size_t tcpPhase = pass % PDM_SUITE_TCP_DROP_EVERY;
+    const size_t btPhase = pass % PDM_SUITE_BT_DROP_EVERY;
+    if (tcpPhase == PDM_SUITE_TCP_DROP_EVERY - 1) {
+        PDMSuite_tcpDrop_();
+    }
+    if (btPhase == PDM_SUITE_BT_DROP_EVERY - 1) {
+        PDMSuite_btDrop_(&peers[0]);
+    } else if (btPhase == 0) {
+        PDMSuite_btConnect_(&peers[0]);
+    }
+    // Replies take a pass to go out: quiet for two passes before a drop, so nothing is in flight.
+    if (tcpPhase < PDM_SUITE_TCP_DROP_EVERY - 2) {
+        PDMSuite_tcpSend_("0");
+    }
+    if (btPhase < PDM_SUITE_BT_DROP_EVERY - 2) {
+        PDMSuite_btSend_(&peers[0], PDM_SUITE_BT_QUERY);
+    }
+    PDMSuite_btSend_(&peers[1], PDM_SUITE_BT_QUERY);
+    PDMSuite_udpSend_(0);
+}
+
+/** Board *****************************************/
+static uint32_t PDMSuite_admissionTotal_() {
+    uint32_t total = 0;
+    for (PDM_DataSource_t source = PDM_WIFI; source < PDM_SOURCE_COUNT; source++) {
+        const PDM_AdmissionStats_t *stats = PDMAdmission_stats(source);
+        total += stats->admitted + stats->dropped + stats->coalesced + stats->busy;
+    }
+    return total;
+}
+
+/** One pass of the loop in application.c, then the clients read their replies. */
+static void PDMSuite_pass_(const size_t pass) {
+    const uint32_t eventsBefore = PDMSuite_admissionTotal_();
+    const int64_t startUs = PDMTest_hostUs();
+    PDMPerf_loopBegin();
+    PDMApp_loop();
+    PDM_CHECK(!PDMApp_isRestartDue(), "restart requested");
+    PDMPerf_loopEnd();
+    const int64_t loopUs = PDMTest_hostUs() - startUs;
+    const uint32_t events = PDMSuite_admissionTotal_() - eventsBefore;
+    if (pass < current->passes) {
+        current->loopUs[pass] = loopUs;
+        current->loopUsTotal += loopUs;
+        current->busyPasses += events > 0;
+        current->events += events;
+    }
+    PDMSuite_collect_();
+    PDMSuite_tcpAccept_();
+    vTaskDelay(pdMS_TO_TICKS(PDM_SUITE_LOOP_MS));
+}
+
+static void *PDMSuite_run_(void *arg) {
+    PDM_SuiteWorkload_t *workload = arg;
+    const uint32_t edges = PDMHost_gpioEdges(BLINK_GPIO);
+    for (size_t pass = 0; pass < workload->passes; pass++) {
+        workload->step(workload, pass);
+        PDMSuite_pass_(pass);
+    }
+    for (uint8_t i = 0; i < 2; i++) { // Last replies go out on the next pass.
+        PDMSuite_pass_(workload->passes);
+    }
+    while (tcpSock < 0) { // Leaves the board connected for the next workload.
+        PDMSuite_pass_(workload->passes);
+    }
+    PDMSuite_btConnect_(&peers[0]);
+    workload->ledEdges = PDMHost_gpioEdges(BLINK_GPIO) - edges;
+    // Requests still unanswered are lost: forget them so they don't take the next workload's replies.
+    tcpFifo.count = 0;
+    for (uint8_t i = 0; i < PDM_BT_MAX_SESSIONS; i++) {
+        peers[i].fifo.count = 0;
+    }
+    memset(udpSentUs, 0xFF, sizeof(udpSentUs));
+    return NULL;
+}
+
+/** Runs a workload in a thread whose stack is painted, to find how deep it went. */
+static void PDMSuite_runWorkload_(PDM_SuiteWorkload_t *workload) {
+    uint8_t *stack = malloc(PDM_SUITE_STACK_LEN);
+    workload->latenciesMs = calloc(workload->passes * 2 * PDM_SUITE_PENDING, sizeof(double));
+    workload->loopUs = calloc(workload->passes, sizeof(double));
+    PDM_CHECK(stack != NULL && workload->latenciesMs != NULL && workload->loopUs != NULL, "out of memory");
+    memset(stack, PDM_SUITE_STACK_PAINT, PDM_SUITE_STACK_LEN);
+    current = workload;
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, PDM_SUITE_STACK_LEN);
+    const size_t heapBefore = PDMTest_heapUsed();
+    PDMTest_resetHeapPeak();
+    PDM_CHECK(pthread_create(&thread, &attr, PDMSuite_run_, workload) == 0, "no thread");
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    workload->heapPeak = PDMTest_heapPeak() - heapBefore;
+
+    // The stack grows down: paint left at the bottom was never reached. glibc keeps the thread's TLS at the top, counted too.
+    size_t untouched = 0;
+    while (untouched < PDM_SUITE_STACK_LEN && stack[untouched] == PDM_SUITE_STACK_PAINT) {
+        untouched++;
+    }
+    workload->stackUsed = PDM_SUITE_STACK_LEN - untouched;
+    free(stack);
+}
+
+static void PDMSuite_print_(FILE *out, PDM_SuiteWorkload_t *workloads, const size_t count) {
+    fprintf(out, "{\"suite\":\"host\",\"workloads\":{");
+    for (size_t i = 0; i < count; i++) {
+        PDM_SuiteWorkload_t *w = &workloads[i];
+        const double seconds = w->passes * PDM_SUITE_LOOP_MS / 1000.0;
+        fprintf(out, "%s\"%s\":{\"passes\":%zu,\"sent\":%zu,\"lost\":%zu,\"events_per_s\":%.2f,"
+                "\"busy_passes_per_s\":%.2f,\"latency_ms_p50\":%.1f,\"latency_ms_p99\":%.1f,\"latency_ms_max\":%.1f,"
+                "\"tcp_reconnects\":%u,\"bt_reconnects\":%u,\"reconnect_ms_max\":%.1f,\"led_edges\":%u,"
+                "\"loop_us_p50\":%.2f,\"loop_us_p99\":%.2f,\"loop_us_max\":%.2f,\"duty_permille\":%.4f,"
+                "\"heap_peak\":%zu,\"stack_used\":%zu}",
+                i > 0 ? "," : "", w->name, w->passes, w->sent, w->sent - w->replies,
+                w->events / seconds, w->busyPasses / seconds,
+                PDMTest_percentile(w->latenciesMs, w->replies, 50),
+                PDMTest_percentile(w->latenciesMs, w->replies, 99),
+                PDMTest_percentile(w->latenciesMs, w->replies, 100),
+                w->tcpReconnects, w->btReconnects, w->reconnectMsMax, w->ledEdges,
+                PDMTest_percentile(w->loopUs, w->passes, 50),
+                PDMTest_percentile(w->loopUs, w->passes, 99),
+                PDMTest_percentile(w->loopUs, w->passes, 100),
+                w->loopUsTotal / (seconds * 1000.0),
+                w->heapPeak, w->stackUsed);
+    }
+    fprintf(out, "}}\n");
+}
+
+int main(int argc, char **argv) {
+    const char *resultsPath = argc > 1 ? argv[1] : NULL;
+    const size_t passes = argc > 2 ? strtoul(argv[2], NULL, 10) : 300;
+    PDM_SuiteWorkload_t workloads[] = {
+        {.name = "idle", .step = PDMSuite_idle_, .passes = passes},
+        {.name = "burst", .step = PDMSuite_burst_, .passes = passes},
+        {.name = "mixed", .step = PDMSuite_mixed_, .passes = passes},
+        {.name = "reconnect_storm", .step = PDMSuite_storm_, .passes = passes},
+    };
+    const size_t workloadCount = sizeof(workloads) / sizeof(workloads[0]);
+    signal(SIGPIPE, SIG_IGN);
+    PDMHost_useRealTime(false);
+    memset(udpSentUs, 0xFF, sizeof(udpSentUs));
+
+    // The server side listens on any free port, handed to the board through NVS.
+    listener = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addrLen = sizeof(addr);
+    PDM_CHECK(listener >= 0 && bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+              listen(listener, 1) == 0 && getsockname(listener, (struct sockaddr *)&addr, &addrLen) == 0,
+              "errno %d", errno);
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    nvs_handle_t nvs;
+    ESP_ERROR_CHECK(nvs_open("pdm_net", NVS_READWRITE, &nvs));
+    ESP_ERROR_CHECK(nvs_set_u16(nvs, "port", ntohs(addr.sin_port)));
+    nvs_close(nvs);
+
+    // init() of application.c.
+    PDMApp_init();
+    PDMTransport_register(PDMBluetooth_transport(), PDM_BT);
+    PDM_CHECK(PDMTransport_init(PDMBluetooth_transport()), "SPP server not started");
+    PDMTransport_register(PDMNetwork_transport(), PDM_WIFI);
+    PDM_CHECK(PDMTransport_init(PDMNetwork_transport()), "TCP connect failed");
+    PDMUdp_setInstanceCount(PDMApp_instanceCount());
+    PDMTransport_register(PDMUdp_transport(), PDM_UDP);
+    PDM_CHECK(PDMTransport_init(PDMUdp_transport()), "UDP port %d busy", CONFIG_PDM_UDP_PORT);
+    PDMPerf_init();
+
+    udpSock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    const struct sockaddr_in board = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_PDM_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    PDM_CHECK(udpSock >= 0 && connect(udpSock, (const struct sockaddr *)&board, sizeof(board)) == 0, "errno %d", errno);
+    fcntl(udpSock, F_SETFL, O_NONBLOCK);
+
+    // Both peers pair while the window is open, and the server starts BT, which starts blinking fast.
+    PDM_SuiteWorkload_t setup = {.name = "setup", .latenciesMs = (double[PDM_SUITE_PENDING]){0}};
+    current = &setup;
+    for (uint8_t i = 0; i < PDM_BT_MAX_SESSIONS; i++) {
+        PDMSuite_btConnect_(&peers[i]);
+    }
+    PDMSuite_tcpAccept_();
+    PDM_CHECK(tcpSock >= 0, "board not connected");
+    PDMSuite_tcpSend_("2");
+    for (uint8_t i = 0; i < 2; i++) {
+        PDMSuite_pass_(0);
+    }
+    PDM_CHECK(setup.replies == 1 && PDMFsm_state(PDMApp_fsm(), 0) == FAST_BLINK, "BT not enabled");
+
+    for (size_t i = 0; i < workloadCount; i++) {
+        PDMSuite_runWorkload_(&workloads[i]); // Lost requests are for the baseline comparison to judge.
+        PDM_CHECK(workloads[i].ledEdges > 0, "%s: LED stopped blinking", workloads[i].name);
+    }
+
+    PDMSuite_print_(stdout, workloads, workloadCount);
+    if (resultsPath != NULL) {
+        FILE *out = fopen(resultsPath, "w");
+        PDM_CHECK(out != NULL, "can't write %s", resultsPath);
+        PDMSuite_print_(out, workloads, workloadCount);
+        fclose(out);
+    }
+    close(tcpSock);
+    close(udpSock);
+    close(listener);
+    return 0;
+}
@@ -0,0 +1,195 @@
+/**
+ * @brief Benchmark of status queries over TCP against UDP, through the
+ *        real tcp_client and udp_status transports on host sockets.
+ *
+ * Usage: bench_udp_tcp [queries] [loop_us]
+ *
+ * The main thread is the board: it runs the main loop every loop_us
+ * (real time, 1 ms by default instead of the board's 100 ms so the run
+ * stays short). A second thread is the server: it accepts the board's
+ * TCP connection and asks for the blink speed one query at a time, then
+ * does the same over UDP. Admission is unlimited so only the transports
+ * are measured. Prints one JSON object with the round trip percentiles
+ * and the CPU time per query of the server thread and of the board.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "host_test.h"
+#include "host_stubs.h"
+#include "app_fsm.h"
+#include "admission.h"
+#include "transport.h"
+#include "tcp_client.h"
+#include "udp_status.h"
+#include "nvs.h"
+#include "lwip/sockets.h"
+
+#define PDM_BENCH_REPLY_TIMEOUT_MS 200
+
+typedef enum {
+    PDM_BENCH_TCP,
+    PDM_BENCH_UDP,
+    PDM_BENCH_DONE,
+} PDM_BenchPhase_t;
+
+typedef struct {
+    double *rttUs;
+    size_t replies;
+    size_t lost;
+    int64_t serverCpuUs;
+    int64_t boardCpuUs;
+} PDM_BenchResult_t;
+
+static const PDM_AdmissionRule_t unlimited_[PDM_SOURCE_COUNT][PDM_CMD_CLASS_COUNT];
+static size_t queries;
+static int serverSock = -1;
+static atomic_int phase = PDM_BENCH_TCP;
+static PDM_BenchResult_t results[PDM_BENCH_DONE];
+
+static int64_t PDMBench_threadCpuUs_() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void PDMBench_setTimeout_(const int sock) {
+    const struct timeval timeout = {.tv_usec = PDM_BENCH_REPLY_TIMEOUT_MS * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+static void PDMBench_tcp_(PDM_BenchResult_t *result) {
+    for (size_t i = 0; i < queries; i++) {
+        const int64_t startUs = PDMTest_hostUs();
+        char reply;
+        PDM_CHECK(send(serverSock, "0", 1, 0) == 1, "errno %d", errno);
+        if (recv(serverSock, &reply, 1, 0) != 1) {
+            result->lost++;
+            continue;
+        }
+        PDM_CHECK(reply >= '0' + SLOW_BLINK && reply <= '0' + BT_DISABLED,
+                  "TCP reply '%c'", reply);
+        result->rttUs[result->replies++] = PDMTest_hostUs() - startUs;
+    }
+}
+
+/** Sends one query, returns its reply length, or -1 on timeout.*/
+static int PDMBench_udpQuery_(const int sock, const uint16_t seq, const int instance, uint8_t *reply) {
+    const uint8_t request[PDM_UDP_REQUEST_LEN + 1] = {PDM_UDP_MAGIC, seq >> 8, seq & 0xFF, 0, instance};
+    const size_t len = instance >= 0 ? sizeof(request) : PDM_UDP_REQUEST_LEN;
+    PDM_CHECK(send(sock, request, len, 0) == len, "errno %d", errno);
+    while (true) {
+        const int got = recv(sock, reply, PDM_UDP_RESPONSE_LEN, 0);
+        if (got < 0) {
+            return -1;
+        }
+        if (got == PDM_UDP_RESPONSE_LEN && reply[1] == (seq >> 8) && reply[2] == (seq & 0xFF)) {
+            return got;
+        }
+        // Late reply to an earlier query, keep waiting for ours.
+    }
+}
+
+static void PDMBench_udp_(PDM_BenchResult_t *result) {
+    const int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    const struct sockaddr_in board = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_PDM_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    PDM_CHECK(sock >= 0 && connect(sock, (const struct sockaddr *)&board, sizeof(board)) == 0, "errno %d", errno);
+    PDMBench_setTimeout_(sock);
+
+    uint8_t reply[PDM_UDP_RESPONSE_LEN];
+    PDM_CHECK(PDMBench_udpQuery_(sock, 0xFFFF, PDMApp_instanceCount(), reply) < 0,
+              "answered a query for a missing instance");
+
+    const int64_t cpuUs = PDMBench_threadCpuUs_();
+    for (size_t i = 0; i < queries; i++) {
+        const int64_t startUs = PDMTest_hostUs();
+        if (PDMBench_udpQuery_(sock, i, -1, reply) < 0) {
+            result->lost++;
+            continue;
+        }
+        PDM_CHECK(reply[0] == PDM_UDP_MAGIC && reply[3] == 0, "malformed UDP reply");
+        result->rttUs[result->replies++] = PDMTest_hostUs() - startUs;
+    }
+    result->serverCpuUs = PDMBench_threadCpuUs_() - cpuUs;
+    close(sock);
+}
+
+static void *PDMBench_server_(void *arg) {
+    int64_t cpuUs = PDMBench_threadCpuUs_();
+    PDMBench_tcp_(&results[PDM_BENCH_TCP]);
+    results[PDM_BENCH_TCP].serverCpuUs = PDMBench_threadCpuUs_() - cpuUs;
+    atomic_store(&phase, PDM_BENCH_UDP);
+    PDMBench_udp_(&results[PDM_BENCH_UDP]);
+    atomic_store(&phase, PDM_BENCH_DONE);
+    return NULL;
+}
+
+static void PDMBench_print_(const char *name, PDM_BenchResult_t *result, const bool isLast) {
+    const size_t asked = queries > 0 ? queries : 1;
+    printf("\"%s\":{\"replies\":%zu,\"lost\":%zu,\"rtt_us_p50\":%.0f,\"rtt_us_p99\":%.0f,\"rtt_us_max\":%.0f,"
+           "\"server_cpu_us_per_query\":%.2f,\"board_cpu_us_per_query\":%.2f}%s",
+           name, result->replies, result->lost,
+           PDMTest_percentile(result->rttUs, result->replies, 50),
+           PDMTest_percentile(result->rttUs, result->replies, 99),
+           PDMTest_percentile(result->rttUs, result->replies, 100),
+           (double)result->serverCpuUs / asked, (double)result->boardCpuUs / asked, isLast ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+    queries = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    const useconds_t loopUs = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+    for (PDM_BenchPhase_t p = PDM_BENCH_TCP; p < PDM_BENCH_DONE; p++) {
+        results[p].rttUs = calloc(queries + 1, sizeof(double));
+        PDM_CHECK(results[p].rttUs != NULL, "out of memory");
+    }
+
+    // The server side listens on any free port, handed to the board through NVS.
+    const int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addrLen = sizeof(addr);
+    PDM_CHECK(listener >= 0 && bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+              listen(listener, 1) == 0 && getsockname(listener, (struct sockaddr *)&addr, &addrLen) == 0,
+              "errno %d", errno);
+    nvs_handle_t nvs;
+    ESP_ERROR_CHECK(nvs_open("pdm_net", NVS_READWRITE, &nvs));
+    ESP_ERROR_CHECK(nvs_set_u16(nvs, "port", ntohs(addr.sin_port)));
+    nvs_close(nvs);
+
+    PDMTransport_register(PDMNetwork_transport(), PDM_WIFI);
+    PDM_CHECK(PDMTransport_init(PDMNetwork_transport()), "TCP connect failed");
+    PDMUdp_setInstanceCount(PDMApp_instanceCount());
+    PDMTransport_register(PDMUdp_transport(), PDM_UDP);
+    PDM_CHECK(PDMTransport_init(PDMUdp_transport()), "UDP port %d busy", CONFIG_PDM_UDP_PORT);
+    PDMApp_init();
+    PDMAdmission_init(&unlimited_[0][0], PDM_SOURCE_COUNT, PDM_CMD_CLASS_COUNT);
+
+    serverSock = accept(listener, NULL, NULL);
+    PDM_CHECK(serverSock >= 0, "errno %d", errno);
+    PDMBench_setTimeout_(serverSock);
+    pthread_t server;
+    PDM_CHECK(pthread_create(&server, NULL, PDMBench_server_, NULL) == 0, "no thread");
+
+    PDM_BenchPhase_t current;
+    while ((current = atomic_load(&phase)) != PDM_BENCH_DONE) {
+        const int64_t cpuUs = PDMBench_threadCpuUs_();
+        PDMApp_loop();
+        results[current].boardCpuUs += PDMBench_threadCpuUs_() - cpuUs;
+        usleep(loopUs);
+    }
+    pthread_join(server, NULL);
+
+    PDM_CHECK(results[PDM_BENCH_TCP].replies > 0 && results[PDM_BENCH_UDP].replies > 0, "no replies");
+    printf("{\"bench\":\"udp_vs_tcp\",\"queries\":%zu,\"loop_us\":%u,", queries, (unsigned)loopUs);
+    PDMBench_print_("tcp", &results[PDM_BENCH_TCP], false);
+    PDMBench_print_("udp", &results[PDM_BENCH_UDP], true);
+    printf("}\n");
+    close(serverSock);
+    close(listener);
+    return 0;
+}
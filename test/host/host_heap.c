@@ -0,0 +1,49 @@
+/**
+ * @brief Heap accounting for the host tests. Link the executable with
+ *        -Wl,--wrap=malloc,--wrap=calloc,--wrap=free: every allocation
+ *        the components make then goes through here.
+*/
+#include <malloc.h>
+#include "host_test.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void __real_free(void *ptr);
+
+static size_t heapUsed = 0;
+static size_t heapPeak = 0;
+
+static void *PDMTest_count_(void *ptr) {
+    if (ptr != NULL) {
+        heapUsed += malloc_usable_size(ptr);
+        heapPeak = heapUsed > heapPeak ? heapUsed : heapPeak;
+    }
+    return ptr;
+}
+
+void *__wrap_malloc(size_t size) {
+    return PDMTest_count_(__real_malloc(size));
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    return PDMTest_count_(__real_calloc(count, size));
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr != NULL) {
+        heapUsed -= malloc_usable_size(ptr);
+    }
+    __real_free(ptr);
+}
+
+size_t PDMTest_heapUsed() {
+    return heapUsed;
+}
+
+size_t PDMTest_heapPeak() {
+    return heapPeak;
+}
+
+void PDMTest_resetHeapPeak() {
+    heapPeak = heapUsed;
+}
@@ -0,0 +1,53 @@
+/**
+ * @brief Helpers shared by the host tests and benchmarks.
+*/
+#ifndef __PDM_HOST_TEST__
+#define __PDM_HOST_TEST__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+/** Fails the test, printing where and why, unless cond holds. */
+#define PDM_CHECK(cond, format, ...) do {                                              \
+        if (!(cond)) {                                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s: " format "\n", __FILE__, __LINE__, \
+                    #cond, ##__VA_ARGS__);                                              \
+            exit(1);                                                                    \
+        }                                                                               \
+    } while (0)
+
+/** Host monotonic time, unaffected by the virtual clock of the stubs. */
+static inline int64_t PDMTest_hostUs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static int PDMTest_compareDoubles_(const void *a, const void *b) {
+    const double da = *(const double *)a, db = *(const double *)b;
+    return da < db ? -1 : da > db;
+}
+
+/** Percentile (0-100) of values, which get sorted. 0 when empty. */
+static inline double PDMTest_percentile(double *values, const size_t count, const double pct) {
+    if (count == 0) {
+        return 0;
+    }
+    qsort(values, count, sizeof(double), PDMTest_compareDoubles_);
+    size_t index = (size_t)(count * pct / 100);
+    return values[index < count ? index : count - 1];
+}
+
+/** Heap Accounting (host_heap.c) ****************/
+/** Bytes allocated and not freed yet. */
+size_t PDMTest_heapUsed();
+
+/** Most bytes allocated at once since the last PDMTest_resetHeapPeak. */
+size_t PDMTest_heapPeak();
+
+/** Starts a new peak from what is allocated now. */
+void PDMTest_resetHeapPeak();
+
+#endif // __PDM_HOST_TEST__
@@ -0,0 +1,69 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "loopback_transport.h"
+
+#include <string.h>
+
+static bool PDMLoopback_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value);
+
+static const PDM_TransportOps_t loopbackOps = {
+    .init = NULL,
+    .poll = NULL,
+    .send = PDMLoopback_send_,
+};
+
+static bool PDMLoopback_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value) {
+    PDM_Loopback_t *loopback = (PDM_Loopback_t *)transport; // transport is its first member.
+    return PDMTransport_queuePush(&loopback->outbox, peer, value); // When full, it stays in the TX queue.
+}
+
+void PDMLoopback_create(PDM_Loopback_t *loopback, const char *name) {
+    memset(loopback, 0, sizeof(*loopback));
+    loopback->transport.name = name;
+    loopback->transport.ops = &loopbackOps;
+}
+
+bool PDMLoopback_inject(PDM_Loopback_t *loopback, const uint32_t peer, const uint32_t value) {
+    return PDMTransport_notify(&loopback->transport, peer, value);
+}
+
+bool PDMLoopback_take(PDM_Loopback_t *loopback, uint32_t *peer, uint32_t *value) {
+    PDM_TransportMessage_t message;
+    if (!PDMTransport_queuePeek(&loopback->outbox, &message)) {
+        return false;
+    }
+    PDMTransport_queueDrop(&loopback->outbox);
+    *peer = message.peer;
+    *value = message.value;
+    return true;
+}
@@ -0,0 +1,92 @@
+/* Copyright 2015-2016, lorsi96 (Lucas Orsi).
+ * All rights reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+/**
+ * @brief In-memory transport. Values injected are received by the
+ *        application and values it sends are kept for inspection.
+ *        Useful to exercise the full dispatch path without a radio.
+ *        Host build only, the firmware has no use for it.
+*/
+#ifndef __PDM_LOOPBACK_TRANSPORT__
+#define __PDM_LOOPBACK_TRANSPORT__
+
+#include "transport.h"
+
+/**
+ * @brief A loopback transport and the values sent through it.
+ */
+typedef struct {
+    PDM_Transport_t transport;   /**< Registered like any other transport. Must be first.*/
+    PDM_TransportQueue_t outbox; /**< Values sent, waiting for PDMLoopback_take.*/
+} PDM_Loopback_t;
+
+/**
+ * @brief Sets up a loopback instance. Register it with PDMTransport_register,
+ *        using PDMLoopback_transport.
+ * 
+ * @param loopback instance to set up. Must outlive its registration.
+ * @param name name used for logging.
+ */
+void PDMLoopback_create(PDM_Loopback_t *loopback, const char *name);
+
+/**
+ * @brief Gets the transport of a loopback instance.
+ */
+static inline PDM_Transport_t *PDMLoopback_transport(PDM_Loopback_t *loopback) {
+    return &loopback->transport;
+}
+
+/**
+ * @brief Simulates a value arriving through a loopback transport.
+ * 
+ * @param loopback instance that receives it.
+ * @param peer simulated sender, echoed back in replies.
+ * @param value received value.
+ * 
+ * @return false if the RX queue was full.
+ */
+bool PDMLoopback_inject(PDM_Loopback_t *loopback, const uint32_t peer, const uint32_t value);
+
+/**
+ * @brief Takes the oldest value sent through a loopback transport.
+ * 
+ * When the outbox is full, further values wait in the TX queue of the
+ * transport, as they would on a congested channel.
+ * 
+ * @param loopback instance to take from.
+ * @param[out] peer who it was sent to.
+ * @param[out] value sent value.
+ * 
+ * @return true if there was a value to take.
+ */
+bool PDMLoopback_take(PDM_Loopback_t *loopback, uint32_t *peer, uint32_t *value);
+
+#endif // __PDM_LOOPBACK_TRANSPORT__
\ No newline at end of file
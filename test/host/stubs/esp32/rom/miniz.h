@@ -0,0 +1,32 @@
+#pragma once
+/*
+ * tinfl over the host zlib, with its window capped at
+ * CONFIG_PDM_OTA_WINDOW_BITS like the board's fixed inflate window:
+ * streams compressed with a larger window fail here too.
+ */
+#include "sdkconfig.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t mz_uint32;
+
+#define TINFL_FLAG_PARSE_ZLIB_HEADER 1
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+typedef enum {
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+typedef struct {
+    void *stream; /**< zlib state, NULL until the first call.*/
+} tinfl_decompressor;
+
+/** Unlike miniz this allocates, the zlib state is released once the stream ends or fails. */
+#define tinfl_init(r) ((r)->stream = NULL)
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                              uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                              const mz_uint32 decomp_flags);
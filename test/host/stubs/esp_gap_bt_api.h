@@ -0,0 +1,92 @@
+#pragma once
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ESP_BD_ADDR_LEN 6
+#define ESP_BT_GAP_MAX_BDNAME_LEN 248
+
+typedef uint8_t esp_bd_addr_t[ESP_BD_ADDR_LEN];
+typedef uint8_t esp_bt_pin_code_t[16];
+
+typedef enum {
+    ESP_BT_STATUS_SUCCESS = 0,
+    ESP_BT_STATUS_FAIL,
+} esp_bt_status_t;
+
+typedef enum {
+    ESP_BT_PIN_TYPE_VARIABLE = 0,
+    ESP_BT_PIN_TYPE_FIXED,
+} esp_bt_pin_type_t;
+
+typedef enum {
+    ESP_BT_NON_CONNECTABLE,
+    ESP_BT_CONNECTABLE,
+} esp_bt_connection_mode_t;
+
+typedef enum {
+    ESP_BT_NON_DISCOVERABLE,
+    ESP_BT_LIMITED_DISCOVERABLE,
+    ESP_BT_GENERAL_DISCOVERABLE,
+} esp_bt_discovery_mode_t;
+
+typedef enum {
+    ESP_BT_GAP_AUTH_CMPL_EVT = 4,
+    ESP_BT_GAP_PIN_REQ_EVT,
+    ESP_BT_GAP_CFM_REQ_EVT,
+    ESP_BT_GAP_KEY_NOTIF_EVT,
+    ESP_BT_GAP_KEY_REQ_EVT,
+    ESP_BT_GAP_MODE_CHG_EVT = 13,
+    ESP_BT_GAP_ACL_CONN_CMPL_STAT_EVT = 16,
+    ESP_BT_GAP_ACL_DISCONN_CMPL_STAT_EVT,
+} esp_bt_gap_cb_event_t;
+
+typedef union {
+    struct {
+        esp_bd_addr_t bda;
+        esp_bt_status_t stat;
+        uint8_t device_name[ESP_BT_GAP_MAX_BDNAME_LEN + 1];
+    } auth_cmpl;
+    struct {
+        esp_bd_addr_t bda;
+        bool min_16_digit;
+    } pin_req;
+    struct {
+        esp_bd_addr_t bda;
+        uint32_t num_val;
+    } cfm_req;
+    struct {
+        esp_bd_addr_t bda;
+        uint32_t passkey;
+    } key_notif;
+    struct {
+        esp_bd_addr_t bda;
+    } key_req;
+    struct {
+        esp_bd_addr_t bda;
+        uint8_t mode;
+    } mode_chg;
+    struct {
+        esp_bt_status_t stat;
+        uint16_t handle;
+        esp_bd_addr_t bda;
+    } acl_conn_cmpl_stat;
+    struct {
+        uint8_t reason;
+        uint16_t handle;
+        esp_bd_addr_t bda;
+    } acl_disconn_cmpl_stat;
+} esp_bt_gap_cb_param_t;
+
+typedef void (*esp_bt_gap_cb_t)(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param);
+
+/** Events are raised by PDMHost_btConnect/PDMHost_btDisconnect, on the caller's thread. */
+esp_err_t esp_bt_gap_register_callback(esp_bt_gap_cb_t callback);
+esp_err_t esp_bt_gap_set_scan_mode(esp_bt_connection_mode_t c_mode, esp_bt_discovery_mode_t d_mode);
+esp_err_t esp_bt_gap_set_pin(esp_bt_pin_type_t pin_type, uint8_t pin_code_len, esp_bt_pin_code_t pin_code);
+esp_err_t esp_bt_gap_pin_reply(esp_bd_addr_t bd_addr, bool accept, uint8_t pin_code_len, esp_bt_pin_code_t pin_code);
+esp_err_t esp_bt_gap_ssp_confirm_reply(esp_bd_addr_t bd_addr, bool accept);
+/** Bonds of the stand-in stack: every peer that connected, up to a handful. */
+int esp_bt_gap_get_bond_device_num(void);
+esp_err_t esp_bt_gap_get_bond_device_list(int *dev_num, esp_bd_addr_t *dev_list);
+esp_err_t esp_bt_gap_remove_bond_device(esp_bd_addr_t bd_addr);
@@ -0,0 +1,25 @@
+#pragma once
+#include "sdkconfig.h"
+#include <stdint.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+/** Prints to stderr when level is within PDMHost_setLogLevel (PDM_HOST_LOG in the environment). */
+void PDMHost_log(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/** Only says how many bytes, at debug level. */
+void esp_log_buffer_hex(const char *tag, const void *buffer, uint16_t buff_len);
+
+#define ESP_LOGE(tag, format, ...) PDMHost_log(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) PDMHost_log(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) PDMHost_log(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) PDMHost_log(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) PDMHost_log(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
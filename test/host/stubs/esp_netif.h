@@ -0,0 +1,9 @@
+#pragma once
+#include "esp_err.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key);
+/** Index of the host loopback interface. */
+int esp_netif_get_netif_impl_index(esp_netif_t *esp_netif);
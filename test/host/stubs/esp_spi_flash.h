@@ -0,0 +1,3 @@
+#pragma once
+#include "esp_err.h"
+#define SPI_FLASH_SEC_SIZE 4096
@@ -0,0 +1,10 @@
+#pragma once
+#include "sdkconfig.h"
+#include <stdint.h>
+#include "esp_err.h"
+
+uint32_t esp_random(void);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+/** Counted by the stubs (PDMHost_restartCount) instead of resetting. */
+void esp_restart(void);
@@ -0,0 +1,6 @@
+#pragma once
+#include "sdkconfig.h"
+#include <stdint.h>
+
+/** Host monotonic time plus whatever vTaskDelay skipped. */
+int64_t esp_timer_get_time(void);
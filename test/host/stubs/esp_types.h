@@ -0,0 +1,5 @@
+#pragma once
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
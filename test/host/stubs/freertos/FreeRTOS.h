@@ -0,0 +1,13 @@
+#pragma once
+#include "sdkconfig.h"
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portTICK_PERIOD_MS (1000 / CONFIG_FREERTOS_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * CONFIG_FREERTOS_HZ) / 1000))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
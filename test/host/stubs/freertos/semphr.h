@@ -0,0 +1,11 @@
+#pragma once
+#include "FreeRTOS.h"
+
+typedef void *SemaphoreHandle_t;
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+
+/** Backed by a pthread mutex. Waits forever, whatever the ticks. */
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
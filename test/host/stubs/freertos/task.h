@@ -0,0 +1,9 @@
+#pragma once
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+TickType_t xTaskGetTickCount(void);
+/** Doesn't sleep: moves the virtual clock forward instead. */
+void vTaskDelay(const TickType_t ticks);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
@@ -0,0 +1,780 @@
+#include <stdio.h>
+#include "host_stubs.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <net/if.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "esp_netif.h"
+#include "esp_ota_ops.h"
+#include "esp32/rom/miniz.h"
+#include <zlib.h>
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_bt_device.h"
+#include "esp_spp_api.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define PDM_HOST_HEAP_SIZE (300 * 1024) /**< Free heap reported, as on an ESP32 with BT and Wi-Fi up.*/
+
+/** Logging ***************************************/
+static int logLevel = -1;
+
+void PDMHost_setLogLevel(const esp_log_level_t level) {
+    logLevel = level;
+}
+
+void PDMHost_log(esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (logLevel < 0) {
+        const char *env = getenv("PDM_HOST_LOG");
+        logLevel = env != NULL ? atoi(env) : ESP_LOG_WARN;
+    }
+    if ((int)level > logLevel) {
+        return;
+    }
+    static const char letters[] = "NEWIDV";
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(esp_timer_get_time() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+void esp_log_buffer_hex(const char *tag, const void *buffer, uint16_t buff_len) {
+    PDMHost_log(ESP_LOG_DEBUG, tag, "%u bytes", buff_len);
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK:                return "ESP_OK";
+    case ESP_FAIL:              return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+    default:                    return "ESP_ERR_UNKNOWN";
+    }
+}
+
+/** Time ******************************************/
+static int64_t virtualUs = 0;
+static bool isRealTime = true;
+
+static int64_t PDMHost_monotonicUs_() {
+    static int64_t startUs = -1;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t nowUs = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    if (startUs < 0) {
+        startUs = nowUs;
+    }
+    return nowUs - startUs;
+}
+
+void PDMHost_advanceMs(const uint32_t ms) {
+    virtualUs += (int64_t)ms * 1000;
+}
+
+void PDMHost_useRealTime(const bool enabled) {
+    if (isRealTime && !enabled) {
+        virtualUs += PDMHost_monotonicUs_(); // Don't let time go backwards.
+    } else if (!isRealTime && enabled) {
+        virtualUs -= PDMHost_monotonicUs_();
+    }
+    isRealTime = enabled;
+}
+
+int64_t esp_timer_get_time(void) {
+    return virtualUs + (isRealTime ? PDMHost_monotonicUs_() : 0);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+void vTaskDelay(const TickType_t ticks) {
+    PDMHost_advanceMs(ticks * portTICK_PERIOD_MS);
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return CONFIG_PDM_MAIN_STACK_SIZE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    pthread_mutex_t *mutex = malloc(sizeof(pthread_mutex_t));
+    if (mutex != NULL) {
+        pthread_mutex_init(mutex, NULL);
+    }
+    return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    return pthread_mutex_lock(semaphore) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return pthread_mutex_unlock(semaphore) == 0 ? pdTRUE : pdFALSE;
+}
+
+/** System ****************************************/
+static uint32_t restartCount = 0;
+
+uint32_t esp_get_free_heap_size(void) {
+    return PDM_HOST_HEAP_SIZE;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return PDM_HOST_HEAP_SIZE;
+}
+
+void esp_restart(void) {
+    restartCount++;
+}
+
+uint32_t PDMHost_restartCount() {
+    return restartCount;
+}
+
+/** GPIO ******************************************/
+static uint32_t gpioLevels[GPIO_NUM_MAX];
+static uint32_t gpioEdges[GPIO_NUM_MAX];
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio) {
+    if (gpio >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpioLevels[gpio] = 0;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode) {
+    return gpio < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level) {
+    if (gpio >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    level = level != 0;
+    if (gpioLevels[gpio] != level) {
+        gpioEdges[gpio]++;
+    }
+    gpioLevels[gpio] = level;
+    return ESP_OK;
+}
+
+uint32_t PDMHost_gpioLevel(const gpio_num_t gpio) {
+    return gpio < GPIO_NUM_MAX ? gpioLevels[gpio] : 0;
+}
+
+uint32_t PDMHost_gpioEdges(const gpio_num_t gpio) {
+    return gpio < GPIO_NUM_MAX ? gpioEdges[gpio] : 0;
+}
+
+/** Flash Partitions ******************************/
+typedef struct {
+    esp_partition_t partition;
+    uint8_t *data; /**< Allocated, erased, on first use.*/
+} PDM_HostPartition_t;
+
+static PDM_HostPartition_t partitions[] = {
+    {{ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 1536 * 1024, "ota_0", false}, NULL},
+    {{ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x190000, 1536 * 1024, "ota_1", false}, NULL},
+    {{ESP_PARTITION_TYPE_DATA, 0x40, 0x3f0000, 4 * SPI_FLASH_SEC_SIZE, "trace", false}, NULL},
+};
+#define PDM_HOST_PARTITIONS (sizeof(partitions) / sizeof(partitions[0]))
+
+static PDM_HostPartition_t *PDMHost_partition_(const esp_partition_t *partition) {
+    for (size_t i = 0; i < PDM_HOST_PARTITIONS; i++) {
+        if (&partitions[i].partition == partition) {
+            if (partitions[i].data == NULL) {
+                partitions[i].data = malloc(partition->size);
+                memset(partitions[i].data, 0xFF, partition->size);
+            }
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    for (size_t i = 0; i < PDM_HOST_PARTITIONS; i++) {
+        const esp_partition_t *p = &partitions[i].partition;
+        if (p->type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || p->subtype == subtype) &&
+            (label == NULL || strcmp(p->label, label) == 0)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size) {
+    PDM_HostPartition_t *p = PDMHost_partition_(partition);
+    if (p == NULL || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, p->data + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size) {
+    PDM_HostPartition_t *p = PDMHost_partition_(partition);
+    if (p == NULL || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        p->data[offset + i] &= bytes[i]; // NOR flash only clears bits.
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    PDM_HostPartition_t *p = PDMHost_partition_(partition);
+    if (p == NULL || offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0 ||
+        offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(p->data + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+uint8_t *PDMHost_partitionData(const char *label, size_t *size) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == NULL) {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, label);
+    }
+    if (partition == NULL) {
+        return NULL;
+    }
+    *size = partition->size;
+    return PDMHost_partition_(partition)->data;
+}
+
+/** OTA Updates ***********************************/
+#define PDM_HOST_IMAGE_MAGIC 0xE9
+
+static const esp_partition_t *bootPartition = NULL; /**< ota_0 until set.*/
+static const esp_partition_t *otaPartition = NULL;  /**< Partition being written, NULL when idle.*/
+static size_t otaWritten = 0;
+static size_t otaErased = 0;
+
+const esp_partition_t *esp_ota_get_running_partition(void) {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void) {
+    return bootPartition != NULL ? bootPartition : esp_ota_get_running_partition();
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from) {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL);
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle) {
+    if (partition == NULL || partition == esp_ota_get_running_partition()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    otaErased = 0;
+    if (image_size != OTA_WITH_SEQUENTIAL_WRITES) {
+        otaErased = image_size == OTA_SIZE_UNKNOWN ? partition->size :
+                    (image_size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+        ESP_ERROR_CHECK(esp_partition_erase_range(partition, 0, otaErased));
+    }
+    otaPartition = partition;
+    otaWritten = 0;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size) {
+    if (otaPartition == NULL || handle != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (otaWritten + size > otaPartition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (otaErased < otaWritten + size) { // Sequential writes erase sector by sector.
+        ESP_ERROR_CHECK(esp_partition_erase_range(otaPartition, otaErased, SPI_FLASH_SEC_SIZE));
+        otaErased += SPI_FLASH_SEC_SIZE;
+    }
+    esp_err_t err = esp_partition_write(otaPartition, otaWritten, data, size);
+    otaWritten += size;
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    if (otaPartition == NULL || handle != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t magic = 0;
+    esp_partition_read(otaPartition, 0, &magic, 1);
+    otaPartition = NULL;
+    return otaWritten > 0 && magic == PDM_HOST_IMAGE_MAGIC ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    otaPartition = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition) {
+    bootPartition = partition;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state) {
+    *ota_state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) {
+    return ESP_OK;
+}
+
+/** Inflate ***************************************/
+static voidpf PDMHost_zalloc_(voidpf opaque, uInt items, uInt size) {
+    return malloc((size_t)items * size); // Through malloc, so tests that count the heap see it.
+}
+
+static void PDMHost_zfree_(voidpf opaque, voidpf address) {
+    free(address);
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                              uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                              const mz_uint32 decomp_flags) {
+    if (r->stream == NULL) {
+        z_stream *fresh = calloc(1, sizeof(z_stream));
+        fresh->zalloc = PDMHost_zalloc_;
+        fresh->zfree = PDMHost_zfree_;
+        if (inflateInit2(fresh, CONFIG_PDM_OTA_WINDOW_BITS) != Z_OK) {
+            free(fresh);
+            return TINFL_STATUS_FAILED;
+        }
+        r->stream = fresh;
+    }
+    z_stream *stream = r->stream;
+    stream->next_in = (Bytef *)pIn_buf_next;
+    stream->avail_in = *pIn_buf_size;
+    stream->next_out = pOut_buf_next;
+    stream->avail_out = *pOut_buf_size;
+    const int ret = inflate(stream, Z_NO_FLUSH);
+    *pIn_buf_size -= stream->avail_in;
+    *pOut_buf_size -= stream->avail_out;
+    if (ret == Z_STREAM_END || (ret != Z_OK && ret != Z_BUF_ERROR)) {
+        inflateEnd(stream);
+        free(stream);
+        r->stream = NULL;
+        return ret == Z_STREAM_END ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+    }
+    if (stream->avail_out == 0) {
+        return TINFL_STATUS_HAS_MORE_OUTPUT;
+    }
+    return (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+}
+
+/** Network Interfaces ****************************/
+esp_err_t esp_netif_init(void) {
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key) {
+    return NULL;
+}
+
+int esp_netif_get_netif_impl_index(esp_netif_t *esp_netif) {
+    return if_nametoindex("lo");
+}
+
+uint32_t esp_random(void) {
+    return (uint32_t)random();
+}
+
+/** NVS *******************************************/
+#define PDM_HOST_NVS_ENTRIES 64
+#define PDM_HOST_NVS_NAMESPACES 8
+
+typedef struct {
+    uint8_t ns;      /**< Handle of the namespace, 0 if the entry is free.*/
+    char key[16];
+    size_t len;
+    uint8_t value[256];
+} PDM_HostNvsEntry_t;
+
+static PDM_HostNvsEntry_t nvsEntries[PDM_HOST_NVS_ENTRIES];
+static char nvsNamespaces[PDM_HOST_NVS_NAMESPACES][16];
+
+static PDM_HostNvsEntry_t *PDMHost_nvsFind_(nvs_handle_t handle, const char *key, const bool create) {
+    PDM_HostNvsEntry_t *free = NULL;
+    for (size_t i = 0; i < PDM_HOST_NVS_ENTRIES; i++) {
+        if (nvsEntries[i].ns == handle && strcmp(nvsEntries[i].key, key) == 0) {
+            return &nvsEntries[i];
+        }
+        if (nvsEntries[i].ns == 0 && free == NULL) {
+            free = &nvsEntries[i];
+        }
+    }
+    if (!create || free == NULL) {
+        return NULL;
+    }
+    free->ns = handle;
+    snprintf(free->key, sizeof(free->key), "%s", key);
+    return free;
+}
+
+static esp_err_t PDMHost_nvsSet_(nvs_handle_t handle, const char *key, const void *value, const size_t len) {
+    PDM_HostNvsEntry_t *entry = PDMHost_nvsFind_(handle, key, true);
+    if (entry == NULL || len > sizeof(entry->value)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(entry->value, value, len);
+    entry->len = len;
+    return ESP_OK;
+}
+
+static esp_err_t PDMHost_nvsGet_(nvs_handle_t handle, const char *key, void *value, const size_t len) {
+    const PDM_HostNvsEntry_t *entry = PDMHost_nvsFind_(handle, key, false);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (entry->len != len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(value, entry->value, len);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    memset(nvsEntries, 0, sizeof(nvsEntries));
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    for (size_t i = 0; i < PDM_HOST_NVS_NAMESPACES; i++) {
+        if (nvsNamespaces[i][0] == '\0') {
+            if (open_mode == NVS_READONLY) {
+                return ESP_ERR_NVS_NOT_FOUND; // Read only doesn't create namespaces.
+            }
+            snprintf(nvsNamespaces[i], sizeof(nvsNamespaces[i]), "%s", name);
+        }
+        if (strcmp(nvsNamespaces[i], name) == 0) {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle) {}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    PDM_HostNvsEntry_t *entry = PDMHost_nvsFind_(handle, key, false);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    memset(entry, 0, sizeof(*entry));
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return PDMHost_nvsSet_(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+    return PDMHost_nvsGet_(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char *key, uint16_t value) {
+    return PDMHost_nvsSet_(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *out_value) {
+    return PDMHost_nvsGet_(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return PDMHost_nvsSet_(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    return PDMHost_nvsGet_(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    return PDMHost_nvsSet_(handle, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return nvs_get_blob(handle, key, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return PDMHost_nvsSet_(handle, key, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    const PDM_HostNvsEntry_t *entry = PDMHost_nvsFind_(handle, key, false);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == NULL) {
+        *length = entry->len; // Size query.
+        return ESP_OK;
+    }
+    if (*length < entry->len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(out_value, entry->value, entry->len);
+    *length = entry->len;
+    return ESP_OK;
+}
+
+/** Bluetooth *************************************/
+#define PDM_HOST_BT_LINKS 4    /**< Peers connected at once, whatever the server accepts.*/
+#define PDM_HOST_BT_BONDS 8
+#define PDM_HOST_BT_OUTBOX 256 /**< Bytes written to a peer and not taken yet.*/
+
+typedef struct {
+    uint32_t handle; /**< 0 if the link is free.*/
+    esp_bd_addr_t bda;
+    uint8_t outbox[PDM_HOST_BT_OUTBOX];
+    size_t outboxLen;
+} PDM_HostBtLink_t;
+
+static esp_bt_gap_cb_t gapCallback = NULL;
+static esp_spp_cb_t sppCallback = NULL;
+static bool isSppStarted = false;
+static bool isPinAccepted = false;
+static uint32_t nextBtHandle = 0x81;
+static PDM_HostBtLink_t btLinks[PDM_HOST_BT_LINKS];
+static esp_bd_addr_t btBonds[PDM_HOST_BT_BONDS];
+static int btBondCount = 0;
+
+static PDM_HostBtLink_t *PDMHost_btLink_(const uint32_t handle) {
+    for (uint8_t i = 0; i < PDM_HOST_BT_LINKS; i++) {
+        if (btLinks[i].handle == handle) {
+            return &btLinks[i];
+        }
+    }
+    return NULL;
+}
+
+static int PDMHost_btBond_(const esp_bd_addr_t bda) {
+    for (int i = 0; i < btBondCount; i++) {
+        if (memcmp(btBonds[i], bda, sizeof(esp_bd_addr_t)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void PDMHost_btGapEvent_(const esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param) {
+    if (gapCallback != NULL) {
+        gapCallback(event, param);
+    }
+}
+
+static void PDMHost_btSppEvent_(const esp_spp_cb_event_t event, esp_spp_cb_param_t *param) {
+    if (sppCallback != NULL) {
+        sppCallback(event, param);
+    }
+}
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_enable(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_dev_set_device_name(const char *name) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_register_callback(esp_bt_gap_cb_t callback) {
+    gapCallback = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_set_scan_mode(esp_bt_connection_mode_t c_mode, esp_bt_discovery_mode_t d_mode) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_set_pin(esp_bt_pin_type_t pin_type, uint8_t pin_code_len, esp_bt_pin_code_t pin_code) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_pin_reply(esp_bd_addr_t bd_addr, bool accept, uint8_t pin_code_len, esp_bt_pin_code_t pin_code) {
+    isPinAccepted = accept;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_ssp_confirm_reply(esp_bd_addr_t bd_addr, bool accept) {
+    isPinAccepted = accept;
+    return ESP_OK;
+}
+
+int esp_bt_gap_get_bond_device_num(void) {
+    return btBondCount;
+}
+
+esp_err_t esp_bt_gap_get_bond_device_list(int *dev_num, esp_bd_addr_t *dev_list) {
+    *dev_num = *dev_num < btBondCount ? *dev_num : btBondCount;
+    memcpy(dev_list, btBonds, *dev_num * sizeof(esp_bd_addr_t));
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_remove_bond_device(esp_bd_addr_t bd_addr) {
+    const int bond = PDMHost_btBond_(bd_addr);
+    if (bond < 0) {
+        return ESP_FAIL;
+    }
+    memmove(btBonds[bond], btBonds[bond + 1], (btBondCount - bond - 1) * sizeof(esp_bd_addr_t));
+    btBondCount--;
+    return ESP_OK;
+}
+
+esp_err_t esp_spp_register_callback(esp_spp_cb_t callback) {
+    sppCallback = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_spp_init(esp_spp_mode_t mode) {
+    esp_spp_cb_param_t param = {.init = {.status = ESP_SPP_SUCCESS}};
+    PDMHost_btSppEvent_(ESP_SPP_INIT_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_spp_start_srv(esp_spp_sec_t sec_mask, esp_spp_role_t role, uint8_t local_scn, const char *name) {
+    isSppStarted = true;
+    esp_spp_cb_param_t param = {.init = {.status = ESP_SPP_SUCCESS}};
+    PDMHost_btSppEvent_(ESP_SPP_START_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_spp_write(uint32_t handle, int len, uint8_t *p_data) {
+    PDM_HostBtLink_t *link = PDMHost_btLink_(handle);
+    if (link == NULL || handle == 0 || link->outboxLen + len > PDM_HOST_BT_OUTBOX) {
+        return ESP_FAIL;
+    }
+    memcpy(link->outbox + link->outboxLen, p_data, len);
+    link->outboxLen += len;
+    esp_spp_cb_param_t param = {.write = {.status = ESP_SPP_SUCCESS, .handle = handle, .len = len}};
+    PDMHost_btSppEvent_(ESP_SPP_WRITE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_spp_disconnect(uint32_t handle) {
+    PDMHost_btDisconnect(handle);
+    return ESP_OK;
+}
+
+uint32_t PDMHost_btConnect(const esp_bd_addr_t bda) {
+    PDM_HostBtLink_t *link = PDMHost_btLink_(0);
+    if (!isSppStarted || link == NULL) {
+        return 0;
+    }
+    esp_bt_gap_cb_param_t gap = {.acl_conn_cmpl_stat = {.stat = ESP_BT_STATUS_SUCCESS}};
+    memcpy(gap.acl_conn_cmpl_stat.bda, bda, sizeof(esp_bd_addr_t));
+    PDMHost_btGapEvent_(ESP_BT_GAP_ACL_CONN_CMPL_STAT_EVT, &gap);
+
+    // New peers pair with the legacy PIN, if the application accepts them.
+    isPinAccepted = PDMHost_btBond_(bda) >= 0;
+    if (!isPinAccepted) {
+        gap = (esp_bt_gap_cb_param_t){.pin_req = {.min_16_digit = false}};
+        memcpy(gap.pin_req.bda, bda, sizeof(esp_bd_addr_t));
+        PDMHost_btGapEvent_(ESP_BT_GAP_PIN_REQ_EVT, &gap);
+        if (isPinAccepted && btBondCount < PDM_HOST_BT_BONDS) {
+            memcpy(btBonds[btBondCount++], bda, sizeof(esp_bd_addr_t));
+        }
+    }
+    gap = (esp_bt_gap_cb_param_t){.auth_cmpl = {.stat = isPinAccepted ? ESP_BT_STATUS_SUCCESS : ESP_BT_STATUS_FAIL}};
+    memcpy(gap.auth_cmpl.bda, bda, sizeof(esp_bd_addr_t));
+    PDMHost_btGapEvent_(ESP_BT_GAP_AUTH_CMPL_EVT, &gap);
+    if (!isPinAccepted) {
+        gap = (esp_bt_gap_cb_param_t){.acl_disconn_cmpl_stat = {.reason = 0x05}};
+        memcpy(gap.acl_disconn_cmpl_stat.bda, bda, sizeof(esp_bd_addr_t));
+        PDMHost_btGapEvent_(ESP_BT_GAP_ACL_DISCONN_CMPL_STAT_EVT, &gap);
+        return 0;
+    }
+
+    link->handle = nextBtHandle++;
+    link->outboxLen = 0;
+    memcpy(link->bda, bda, sizeof(esp_bd_addr_t));
+    esp_spp_cb_param_t spp = {.srv_open = {.status = ESP_SPP_SUCCESS, .handle = link->handle}};
+    memcpy(spp.srv_open.rem_bda, bda, sizeof(esp_bd_addr_t));
+    const uint32_t handle = link->handle;
+    PDMHost_btSppEvent_(ESP_SPP_SRV_OPEN_EVT, &spp); // May disconnect it right away.
+    return PDMHost_btLink_(handle) != NULL ? handle : 0;
+}
+
+void PDMHost_btDisconnect(const uint32_t handle) {
+    PDM_HostBtLink_t *link = PDMHost_btLink_(handle);
+    if (handle == 0 || link == NULL) {
+        return;
+    }
+    link->handle = 0;
+    esp_spp_cb_param_t spp = {.close = {.status = ESP_SPP_SUCCESS, .handle = handle}};
+    PDMHost_btSppEvent_(ESP_SPP_CLOSE_EVT, &spp);
+    esp_bt_gap_cb_param_t gap = {.acl_disconn_cmpl_stat = {.reason = 0x13}};
+    memcpy(gap.acl_disconn_cmpl_stat.bda, link->bda, sizeof(esp_bd_addr_t));
+    PDMHost_btGapEvent_(ESP_BT_GAP_ACL_DISCONN_CMPL_STAT_EVT, &gap);
+}
+
+bool PDMHost_btReceive(const uint32_t handle, const void *data, const uint16_t len) {
+    if (handle == 0 || PDMHost_btLink_(handle) == NULL) {
+        return false;
+    }
+    esp_spp_cb_param_t spp = {.data_ind = {.status = ESP_SPP_SUCCESS, .handle = handle, .len = len, .data = (uint8_t *)data}};
+    PDMHost_btSppEvent_(ESP_SPP_DATA_IND_EVT, &spp);
+    return true;
+}
+
+size_t PDMHost_btTake(const uint32_t handle, uint8_t *data, const size_t len) {
+    PDM_HostBtLink_t *link = PDMHost_btLink_(handle);
+    if (handle == 0 || link == NULL) {
+        return 0;
+    }
+    const size_t taken = link->outboxLen < len ? link->outboxLen : len;
+    memcpy(data, link->outbox, taken);
+    memmove(link->outbox, link->outbox + taken, link->outboxLen - taken);
+    link->outboxLen -= taken;
+    return taken;
+}
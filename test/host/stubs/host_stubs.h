@@ -0,0 +1,94 @@
+/**
+ * @brief Controls of the host stand-ins for ESP-IDF and FreeRTOS.
+ * 
+ * Time is the host monotonic clock plus a virtual offset: vTaskDelay
+ * returns at once and moves the offset forward, so a benchmark runs the
+ * main loop at its real cost without waiting for its idle time. Flash
+ * partitions and NVS live in RAM and GPIOs only remember their level.
+ * lwip sockets are the host's BSD sockets. Bluetooth is an SPP server
+ * whose peers are driven with the PDMHost_bt* calls below.
+*/
+#ifndef __PDM_HOST_STUBS__
+#define __PDM_HOST_STUBS__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_log.h"
+#include "driver/gpio.h"
+#include "esp_gap_bt_api.h"
+
+/**
+ * @brief Sets the most verbose level printed. Starts at PDM_HOST_LOG
+ *        from the environment (0-5), or ESP_LOG_WARN.
+ */
+void PDMHost_setLogLevel(const esp_log_level_t level);
+
+/**
+ * @brief Moves the virtual clock forward, as a vTaskDelay would.
+ */
+void PDMHost_advanceMs(const uint32_t ms);
+
+/**
+ * @brief Whether time also includes the host clock (the default).
+ * 
+ * Without it time only moves with vTaskDelay and PDMHost_advanceMs,
+ * which makes rate limits and timeouts deterministic.
+ */
+void PDMHost_useRealTime(const bool enabled);
+
+/**
+ * @brief Contents of a RAM backed flash partition.
+ * 
+ * @param label partition label (e.g. "trace").
+ * @param[out] size partition size.
+ * 
+ * @return the partition contents, NULL if there's no such partition.
+ */
+uint8_t *PDMHost_partitionData(const char *label, size_t *size);
+
+/**
+ * @brief Last level written to a GPIO.
+ */
+uint32_t PDMHost_gpioLevel(const gpio_num_t gpio);
+
+/**
+ * @brief Number of level changes written to a GPIO.
+ */
+uint32_t PDMHost_gpioEdges(const gpio_num_t gpio);
+
+/**
+ * @brief Number of times esp_restart was called.
+ */
+uint32_t PDMHost_restartCount();
+
+/**
+ * @brief Connects a peer to the SPP server: ACL link, authentication
+ *        (pairing with the PIN if the peer is new) and SPP session.
+ *        Events reach the application's callbacks before it returns.
+ * 
+ * @return SPP handle of the session, 0 if pairing was refused, the
+ *         server isn't started or it turned the peer away.
+ */
+uint32_t PDMHost_btConnect(const esp_bd_addr_t bda);
+
+/**
+ * @brief Closes the SPP session and ACL link of a peer.
+ */
+void PDMHost_btDisconnect(const uint32_t handle);
+
+/**
+ * @brief Delivers data sent by a peer, in one SPP data event.
+ * 
+ * @return false if the peer isn't connected.
+ */
+bool PDMHost_btReceive(const uint32_t handle, const void *data, const uint16_t len);
+
+/**
+ * @brief Takes what the application wrote to a peer, oldest first.
+ * 
+ * @return bytes copied to data.
+ */
+size_t PDMHost_btTake(const uint32_t handle, uint8_t *data, const size_t len);
+
+#endif // __PDM_HOST_STUBS__
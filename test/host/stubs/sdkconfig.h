@@ -0,0 +1,39 @@
+/**
+ * @brief Configuration of the host build. Mirrors the options the
+ *        components read, with values suited to tests and benchmarks.
+ */
+#pragma once
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_PDM_MAIN_STACK_SIZE 4096
+
+#define CONFIG_PDM_TRACE_ENABLED 1
+#define CONFIG_PDM_TRACE_RING_LEN 64
+#define CONFIG_PDM_TRACE_FLASH 1
+
+#define CONFIG_PDM_ADMISSION_ENABLED 1
+#define CONFIG_PDM_ADMISSION_LOG_PERIOD_S 60
+
+#define CONFIG_EXAMPLE_IPV4 1
+#define CONFIG_EXAMPLE_IPV4_ADDR "127.0.0.1"
+#define CONFIG_EXAMPLE_PORT 3333
+#define CONFIG_PDM_NET_FALLBACK_HOSTS ""
+#define CONFIG_PDM_NET_NVS_OVERRIDE 1
+
+/* Rate limited far above the board defaults, so benchmarks measure the path, not the limiter. */
+#define CONFIG_PDM_UDP_ENABLED 1
+#define CONFIG_PDM_UDP_PORT 43334
+#define CONFIG_PDM_UDP_RATE_PER_SEC 1000
+#define CONFIG_PDM_UDP_BURST 100
+
+#define CONFIG_PDM_OTA_ENABLED 1
+#define CONFIG_PDM_OTA_WINDOW_BITS 12
+
+#define CONFIG_BTDM_CTRL_BR_EDR_MAX_ACL_CONN 2
+#define CONFIG_PDM_BT_PIN "1234"
+#define CONFIG_PDM_BT_MAX_BONDS 4
+#define CONFIG_PDM_BT_PAIRING_WINDOW_S 60
+#define CONFIG_PDM_BT_HIDE_WHEN_BONDED 1
+
+#define CONFIG_PDM_PERF_ENABLED 1
+#define CONFIG_PDM_PERF_REPORT_PERIOD_S 10
@@ -0,0 +1,232 @@
+/**
+ * @brief Firmware update tests: the decompress and write pipeline of
+ *        ota_update, then a whole update over TCP up to the restart.
+ *
+ * Usage: test_ota [image KB]
+ *
+ * The pipeline run feeds a zlib compressed image to PDMOta_write in TCP
+ * segment sized chunks and checks what lands in the RAM backed ota_1
+ * slot. It prints one JSON object with the throughput, the slowest
+ * chunk (main loop time taken by one poll) and the heap peak of the
+ * update. inflate is the host zlib here, not the ROM tinfl, so the peak
+ * is indicative: the decompressor state differs in size.
+ *
+ * The TCP run streams an image through tcp_client and the FSM, as
+ * server.py does, and checks the server reads the result and the end of
+ * the connection before the board restarts. Before that, on the same
+ * connection, it streams one the board can't take: the board must
+ * report the failure and drop the rest of the stream, answering only the
+ * query that follows it.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "host_test.h"
+#include "host_stubs.h"
+#include "app_fsm.h"
+#include "transport.h"
+#include "tcp_client.h"
+#include "ota_update.h"
+#include "admission.h"
+#include "esp_ota_ops.h"
+#include "nvs.h"
+#include "lwip/sockets.h"
+
+#define PDM_TEST_CHUNK_LEN 1436      /**< One TCP segment over lwIP.*/
+#define PDM_TEST_TCP_IMAGE_LEN 65536
+#define PDM_TEST_LOOP_US 10000
+
+/** Images ****************************************/
+/** Something shaped like firmware: code-like runs that repeat nearby, and noise. */
+static uint8_t *PDMTest_image_(const size_t len) {
+    uint8_t *image = calloc(len, 1);
+    PDM_CHECK(image != NULL, "out of memory");
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        const bool repeats = i >= 512 && (seed >> 16) % 4 != 0;
+        image[i] = repeats ? image[i - 256 - (seed >> 28) * 16] : (uint8_t)(seed >> 16);
+    }
+    image[0] = 0xE9; // ESP image magic.
+    return image;
+}
+
+/** Builds the update stream: header and image compressed with the given window. */
+static uint8_t *PDMTest_stream_(const uint8_t *image, const size_t len, const int windowBits, size_t *streamLen) {
+    z_stream z = {0};
+    PDM_CHECK(deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK, "zlib");
+    const size_t bound = deflateBound(&z, len);
+    uint8_t *stream = calloc(PDM_OTA_HEADER_LEN + bound, 1);
+    PDM_CHECK(stream != NULL, "out of memory");
+    z.next_in = (Bytef *)image;
+    z.avail_in = len;
+    z.next_out = stream + PDM_OTA_HEADER_LEN;
+    z.avail_out = bound;
+    PDM_CHECK(deflate(&z, Z_FINISH) == Z_STREAM_END, "zlib");
+    const uint32_t sizes[2] = {z.total_out, len};
+    deflateEnd(&z);
+    memcpy(stream, PDM_OTA_MAGIC, 4);
+    memcpy(stream + 4, sizes, sizeof(sizes)); // Host is little endian, as the header.
+    *streamLen = PDM_OTA_HEADER_LEN + sizes[0];
+    return stream;
+}
+
+static PDM_OtaStatus_t PDMTest_feed_(const uint8_t *stream, const size_t len, double *maxChunkUs) {
+    PDM_OtaStatus_t status = PDM_OTA_IN_PROGRESS;
+    for (size_t offset = 0; offset < len && status == PDM_OTA_IN_PROGRESS; offset += PDM_TEST_CHUNK_LEN) {
+        const size_t chunk = len - offset < PDM_TEST_CHUNK_LEN ? len - offset : PDM_TEST_CHUNK_LEN;
+        const int64_t startUs = PDMTest_hostUs();
+        status = PDMOta_write(stream + offset, chunk);
+        const double chunkUs = PDMTest_hostUs() - startUs;
+        if (maxChunkUs != NULL && chunkUs > *maxChunkUs) {
+            *maxChunkUs = chunkUs;
+        }
+    }
+    return status;
+}
+
+/** Pipeline **************************************/
+static void PDMTest_pipeline_(const size_t imageLen) {
+    size_t slotLen;
+    const uint8_t *slot = PDMHost_partitionData("ota_1", &slotLen); // Allocated now, not counted below.
+    PDM_CHECK(slot != NULL && imageLen <= slotLen, "image doesn't fit ota_1");
+    uint8_t *image = PDMTest_image_(imageLen);
+    size_t streamLen;
+    uint8_t *stream = PDMTest_stream_(image, imageLen, CONFIG_PDM_OTA_WINDOW_BITS, &streamLen);
+
+    const size_t heapBefore = PDMTest_heapUsed();
+    PDMTest_resetHeapPeak();
+    double maxChunkUs = 0;
+    const int64_t startUs = PDMTest_hostUs();
+    PDM_CHECK(PDMOta_begin(), "begin");
+    const PDM_OtaStatus_t status = PDMTest_feed_(stream, streamLen, &maxChunkUs);
+    const int64_t elapsedUs = PDMTest_hostUs() - startUs;
+    PDM_CHECK(status == PDM_OTA_DONE, "status %d", status);
+    PDM_CHECK(memcmp(slot, image, imageLen) == 0, "ota_1 differs from the image");
+    PDM_CHECK(esp_ota_get_boot_partition() == esp_ota_get_next_update_partition(NULL), "boot partition not set");
+    PDM_CHECK(PDMTest_heapUsed() == heapBefore, "update leaked %zu bytes", PDMTest_heapUsed() - heapBefore);
+    const size_t updatePeak = PDMTest_heapPeak() - heapBefore;
+
+    // A stream cut short, and one needing a larger window than the board has, must fail.
+    PDM_CHECK(PDMOta_begin(), "begin");
+    PDM_CHECK(PDMTest_feed_(stream, streamLen / 2, NULL) == PDM_OTA_IN_PROGRESS, "half a stream finished");
+    PDMOta_abort();
+    if (CONFIG_PDM_OTA_WINDOW_BITS < 15) {
+        size_t wideLen;
+        uint8_t *wide = PDMTest_stream_(image, imageLen, 15, &wideLen);
+        PDM_CHECK(PDMOta_begin(), "begin");
+        PDM_CHECK(PDMTest_feed_(wide, wideLen, NULL) == PDM_OTA_FAILED, "accepted a 32 KB window");
+        free(wide);
+    }
+
+    printf("{\"test\":\"ota_pipeline\",\"image_bytes\":%zu,\"stream_bytes\":%zu,\"chunk_bytes\":%d,"
+           "\"window_bits\":%d,\"mb_per_s\":%.1f,\"chunk_us_max\":%.0f,\"heap_peak_bytes\":%zu}\n",
+           imageLen, streamLen, PDM_TEST_CHUNK_LEN, CONFIG_PDM_OTA_WINDOW_BITS,
+           imageLen / (double)(elapsedUs > 0 ? elapsedUs : 1), maxChunkUs, updatePeak);
+    free(image);
+    free(stream);
+}
+
+/** Update Over TCP *******************************/
+static const PDM_AdmissionRule_t unlimited_[PDM_SOURCE_COUNT][PDM_CMD_CLASS_COUNT]; /**< Two updates in a row.*/
+
+typedef struct {
+    int sock;
+    const uint8_t *stream;
+    size_t streamLen;
+    const uint8_t *badStream; /**< Needs a larger window than the board has.*/
+    size_t badStreamLen;
+    char badResult;
+    char result;
+    int64_t resultUs; /**< When the server read the update result.*/
+    int64_t closedUs; /**< When the server saw the board close the connection.*/
+} PDM_TestServer_t;
+
+static char PDMTest_update_(PDM_TestServer_t *server, const uint8_t *stream, const size_t streamLen) {
+    char reply = 0;
+    PDM_CHECK(send(server->sock, "3", 1, 0) == 1 && recv(server->sock, &reply, 1, 0) == 1 && reply == '0',
+              "board not ready for the update ('%c')", reply);
+    PDM_CHECK(send(server->sock, stream, streamLen, 0) == (ssize_t)streamLen, "errno %d", errno);
+    PDM_CHECK(recv(server->sock, &reply, 1, 0) == 1, "no update result");
+    return reply;
+}
+
+static void *PDMTest_server_(void *arg) {
+    PDM_TestServer_t *server = arg;
+    char reply = 0;
+    server->badResult = PDMTest_update_(server, server->badStream, server->badStreamLen);
+    // Had the rest of the stream been parsed, its digits would be answered too.
+    char replies[64];
+    PDM_CHECK(send(server->sock, "0", 1, 0) == 1 && recv(server->sock, replies, 1, 0) == 1 &&
+              replies[0] >= '0' && replies[0] <= '9', "query after the failed update answered '%c'", replies[0]);
+    const struct timeval timeout = {.tv_usec = 300000};
+    setsockopt(server->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    const ssize_t extra = recv(server->sock, replies, sizeof(replies), 0);
+    PDM_CHECK(extra < 0, "%zd replies to the rest of the failed stream", extra);
+    const struct timeval forever = {0};
+    setsockopt(server->sock, SOL_SOCKET, SO_RCVTIMEO, &forever, sizeof(forever));
+
+    server->result = PDMTest_update_(server, server->stream, server->streamLen);
+    server->resultUs = PDMTest_hostUs();
+    PDM_CHECK(recv(server->sock, &reply, 1, 0) == 0, "connection not closed");
+    server->closedUs = PDMTest_hostUs();
+    return NULL;
+}
+
+static void PDMTest_updateOverTcp_() {
+    const int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addrLen = sizeof(addr);
+    PDM_CHECK(listener >= 0 && bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+              listen(listener, 1) == 0 && getsockname(listener, (struct sockaddr *)&addr, &addrLen) == 0,
+              "errno %d", errno);
+    nvs_handle_t nvs;
+    ESP_ERROR_CHECK(nvs_open("pdm_net", NVS_READWRITE, &nvs));
+    ESP_ERROR_CHECK(nvs_set_u16(nvs, "port", ntohs(addr.sin_port)));
+    nvs_close(nvs);
+
+    PDMTransport_register(PDMNetwork_transport(), PDM_WIFI);
+    PDM_CHECK(PDMTransport_init(PDMNetwork_transport()), "TCP connect failed");
+    PDMApp_init();
+    PDMAdmission_init(&unlimited_[0][0], PDM_SOURCE_COUNT, PDM_CMD_CLASS_COUNT);
+
+    uint8_t *image = PDMTest_image_(PDM_TEST_TCP_IMAGE_LEN);
+    PDM_TestServer_t server = {.sock = accept(listener, NULL, NULL)};
+    PDM_CHECK(server.sock >= 0, "errno %d", errno);
+    server.stream = PDMTest_stream_(image, PDM_TEST_TCP_IMAGE_LEN, CONFIG_PDM_OTA_WINDOW_BITS, &server.streamLen);
+    server.badStream = PDMTest_stream_(image, PDM_TEST_TCP_IMAGE_LEN, 15, &server.badStreamLen);
+    pthread_t thread;
+    PDM_CHECK(pthread_create(&thread, NULL, PDMTest_server_, &server) == 0, "no thread");
+
+    // The main loop of application.c, in real time.
+    const int64_t deadlineUs = PDMTest_hostUs() + 20 * 1000000;
+    while (!PDMApp_isRestartDue()) {
+        PDM_CHECK(PDMTest_hostUs() < deadlineUs, "no restart");
+        PDMApp_loop();
+        usleep(PDM_TEST_LOOP_US);
+    }
+    const int64_t restartUs = PDMTest_hostUs();
+    esp_restart();
+    pthread_join(thread, NULL);
+
+    PDM_CHECK(server.badResult == '1', "result of an update needing a 32 KB window '%c'", server.badResult);
+    PDM_CHECK(server.result == '0', "update result '%c'", server.result);
+    PDM_CHECK(server.resultUs < restartUs && server.closedUs < restartUs, "restarted before the server read the result");
+    PDM_CHECK(PDMHost_restartCount() == 1, "%u restarts", PDMHost_restartCount());
+    printf("{\"test\":\"ota_over_tcp\",\"stream_bytes\":%zu,\"result_to_restart_ms\":%.0f}\n",
+           server.streamLen, (restartUs - server.resultUs) / 1000.0);
+    close(server.sock);
+    close(listener);
+    free(image);
+    free((void *)server.stream);
+    free((void *)server.badStream);
+}
+
+int main(int argc, char **argv) {
+    const size_t imageLen = (argc > 1 ? strtoul(argv[1], NULL, 10) : 1024) * 1024;
+    PDMTest_pipeline_(imageLen);
+    PDMTest_updateOverTcp_();
+    return 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * @brief Records a scripted session in the FSM trace and dumps the
+ *        trace partition for trace_replay.
+ * 
+ * Usage: test_trace <trace dump> <tampered dump>
+ * 
+ * Some commands target an LED the board doesn't have, and must be
+ * rejected. The second dump has one recorded transition altered, so
+ * replaying it must fail.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "host_test.h"
+#include "host_stubs.h"
+#include "app_fsm.h"
+#include "fsm_trace.h"
+#include "transport.h"
+#include "loopback_transport.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_spi_flash.h"
+
+#define PDM_TEST_COMMANDS 150 /**< Two full laps of the host ring plus some.*/
+#define PDM_TEST_REJECT_EVERY 10
+
+static void PDMTest_write_(const char *path, const uint8_t *data, const size_t len) {
+    FILE *f = fopen(path, "wb");
+    PDM_CHECK(f != NULL, "unable to create %s", path);
+    PDM_CHECK(fwrite(data, 1, len, f) == len, "unable to write %s", path);
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    PDM_CHECK(argc == 3, "usage: %s <trace dump> <tampered dump>", argv[0]);
+    PDMHost_useRealTime(false);
+    static PDM_Loopback_t server;
+    PDMLoopback_create(&server, "server");
+    PDMTransport_register(PDMLoopback_transport(&server), PDM_WIFI);
+    PDMApp_init();
+
+    // Queries and toggles of the BT service, from three peers. Now and then one for a missing LED.
+    static const uint8_t script[] = {0, 1, 2, 0, 0, 1, 2, 1, 0, 2, 2, 0};
+    uint32_t replies = 0, errors = 0;
+    for (uint32_t i = 0; i < PDM_TEST_COMMANDS + 2; i++) {
+        if (i < PDM_TEST_COMMANDS) {
+            const uint16_t instance = i % PDM_TEST_REJECT_EVERY == PDM_TEST_REJECT_EVERY / 2 ? PDMApp_instanceCount() : 0;
+            PDM_CHECK(PDMLoopback_inject(&server, i % 3 + 1, PDM_TRANSPORT_COMMAND(script[i % sizeof(script)], instance)),
+                      "RX queue full at %u", i);
+        }
+        PDMApp_loop();
+        uint32_t peer, value;
+        while (PDMLoopback_take(&server, &peer, &value)) {
+            replies++;
+            errors += value == PDM_ERROR_REPLY;
+        }
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    PDM_CHECK(replies == PDM_TEST_COMMANDS, "%u replies to %u commands", replies, PDM_TEST_COMMANDS);
+    PDM_CHECK(errors == PDM_TEST_COMMANDS / PDM_TEST_REJECT_EVERY, "%u commands for a missing LED rejected", errors);
+    PDMTrace_flush();
+
+    size_t len;
+    uint8_t *image = PDMHost_partitionData(PDM_TRACE_PARTITION, &len);
+    PDM_CHECK(image != NULL, "no trace partition");
+    PDMTest_write_(argv[1], image, len);
+
+    // Flip the next state of the first matched record.
+    for (size_t offset = 0; offset < len; offset += SPI_FLASH_SEC_SIZE) {
+        PDM_TraceSectorHeader_t header;
+        memcpy(&header, image + offset, sizeof(header));
+        if (header.magic != PDM_TRACE_MAGIC || header.count == 0) {
+            continue;
+        }
+        PDM_TraceRecord_t *record = (PDM_TraceRecord_t *)(image + offset + sizeof(header));
+        record->nextState = (record->nextState + 1) % (BT_DISABLED + 1);
+        break;
+    }
+    PDMTest_write_(argv[2], image, len);
+    printf("%u commands, %u replies, %u rejected\n", PDM_TEST_COMMANDS, replies, errors);
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * @brief Checks the UDP rate limiter at a rate above the tick rate.
+ *
+ * The host stubs tick at 100 Hz and answer 1000 queries per second, so a
+ * tick is worth 10 queries. With the clock stopped only the burst may be
+ * answered; each millisecond after that earns exactly one more query,
+ * and a long pause never earns more than the burst.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "host_test.h"
+#include "host_stubs.h"
+#include "transport.h"
+#include "udp_status.h"
+#include "lwip/sockets.h"
+
+#define PDM_TEST_UDP_ID 0
+#define PDM_TEST_FLOOD 300 /**< Queries sent at once, well above the burst.*/
+
+static int client = -1;
+
+/** Sends count queries, lets the transport take them and answers those it admits. */
+static uint32_t PDMTest_admitted_(const uint32_t count) {
+    const uint8_t request[PDM_UDP_REQUEST_LEN] = {PDM_UDP_MAGIC, 0, 0, 0};
+    uint32_t admitted = 0;
+    for (uint32_t sent = 0; sent < count;) {
+        // No more than a poll reads, so none is dropped for the RX queue being full.
+        for (uint8_t i = 0; i < PDM_TRANSPORT_QUEUE_LEN && sent < count; i++, sent++) {
+            PDM_CHECK(send(client, request, sizeof(request), 0) == sizeof(request), "errno %d", errno);
+        }
+        PDMTransport_task();
+        PDM_TransportId_t id;
+        uint32_t peer, value;
+        while (PDMTransport_receive(&id, &peer, &value)) {
+            PDMTransport_send(id, peer, 0);
+            admitted++;
+        }
+        PDMTransport_task(); // Replies, freeing the pending slots.
+    }
+    uint8_t reply[PDM_UDP_RESPONSE_LEN];
+    while (recv(client, reply, sizeof(reply), 0) > 0) {
+    }
+    return admitted;
+}
+
+int main() {
+    PDMHost_useRealTime(false);
+    PDMTransport_register(PDMUdp_transport(), PDM_TEST_UDP_ID);
+    PDM_CHECK(PDMTransport_init(PDMUdp_transport()), "UDP port %d busy", CONFIG_PDM_UDP_PORT);
+    PDM_CHECK(CONFIG_PDM_UDP_RATE_PER_SEC > CONFIG_FREERTOS_HZ, "the rate must be above the tick rate");
+
+    client = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    const struct sockaddr_in board = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_PDM_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    PDM_CHECK(client >= 0 && connect(client, (const struct sockaddr *)&board, sizeof(board)) == 0, "errno %d", errno);
+    fcntl(client, F_SETFL, O_NONBLOCK);
+
+    uint32_t admitted = PDMTest_admitted_(PDM_TEST_FLOOD);
+    PDM_CHECK(admitted == CONFIG_PDM_UDP_BURST, "%u of a flood admitted, burst is %d", admitted, CONFIG_PDM_UDP_BURST);
+
+    // Well within a tick: each millisecond is worth one query.
+    for (uint8_t ms = 0; ms < 20; ms++) {
+        PDMHost_advanceMs(1);
+        admitted = PDMTest_admitted_(PDM_TRANSPORT_QUEUE_LEN);
+        PDM_CHECK(admitted == 1, "%u admitted after 1 ms", admitted);
+    }
+
+    PDMHost_advanceMs(37);
+    admitted = PDMTest_admitted_(PDM_TEST_FLOOD);
+    PDM_CHECK(admitted == 37 * CONFIG_PDM_UDP_RATE_PER_SEC / 1000, "%u admitted after 37 ms", admitted);
+
+    PDMHost_advanceMs(60000);
+    admitted = PDMTest_admitted_(PDM_TEST_FLOOD);
+    PDM_CHECK(admitted == CONFIG_PDM_UDP_BURST, "%u admitted after a pause, burst is %d", admitted, CONFIG_PDM_UDP_BURST);
+
+    printf("{\"rate_per_s\":%d,\"tick_hz\":%d,\"burst\":%d}\n",
+           CONFIG_PDM_UDP_RATE_PER_SEC, CONFIG_FREERTOS_HZ, CONFIG_PDM_UDP_BURST);
+    return 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * @brief Replays a flushed FSM trace against the application table.
+ * 
+ * Usage: trace_replay <trace partition dump>
+ * 
+ * Every record is turned back into the event that caused it and fed to
+ * PDMFsm_dispatch, on a fresh FSM running PDMApp_table(). The transition
+ * and match of each dispatch must be the recorded ones, and events
+ * rejected for a missing instance must still target a missing one; the exit
+ * status is 1 otherwise. Replies from the handlers go to sink transports.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "app_fsm.h"
+#include "fsm.h"
+#include "fsm_trace.h"
+#include "transport.h"
+#include "esp_spi_flash.h"
+
+/** One flushed sector, to put them in order.*/
+typedef struct {
+    uint32_t sequence;
+    size_t offset;
+    uint16_t count;
+} PDM_ReplaySector_t;
+
+static PDM_FsmDispatch_t lastDispatch;
+static uint32_t replies = 0;
+
+static void PDMReplay_observe_(const PDM_FsmDispatch_t *dispatch) {
+    lastDispatch = *dispatch;
+}
+
+static bool PDMReplay_send_(PDM_Transport_t *transport, const uint32_t peer, const uint32_t value) {
+    replies++;
+    return true;
+}
+
+static const PDM_TransportOps_t sinkOps = {
+    .init = NULL,
+    .poll = NULL,
+    .send = PDMReplay_send_,
+};
+
+static PDM_Transport_t sinks[PDM_SOURCE_COUNT];
+
+static int PDMReplay_compareSectors_(const void *a, const void *b) {
+    const PDM_ReplaySector_t *sa = a, *sb = b;
+    return sa->sequence < sb->sequence ? -1 : sa->sequence > sb->sequence;
+}
+
+static int PDMReplay_compareUs_(const void *a, const void *b) {
+    const uint16_t ua = *(const uint16_t *)a, ub = *(const uint16_t *)b;
+    return ua < ub ? -1 : ua > ub;
+}
+
+static void PDMReplay_printUs_(const char *what, uint16_t *us, const size_t count) {
+    if (count == 0) {
+        return;
+    }
+    qsort(us, count, sizeof(uint16_t), PDMReplay_compareUs_);
+    printf("%s handler us: p50=%u p99=%u max=%u\n", what,
+           us[count / 2], us[count * 99 / 100], us[count - 1]);
+}
+
+static uint8_t *PDMReplay_load_(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *image = malloc(*len);
+    if (image != NULL && fread(image, 1, *len, f) != *len) {
+        free(image);
+        image = NULL;
+    }
+    fclose(f);
+    return image;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace partition dump>\n", argv[0]);
+        return 2;
+    }
+    size_t len;
+    uint8_t *image = PDMReplay_load_(argv[1], &len);
+    if (image == NULL) {
+        fprintf(stderr, "Unable to read %s\n", argv[1]);
+        return 2;
+    }
+
+    PDM_ReplaySector_t sectors[len / SPI_FLASH_SEC_SIZE + 1];
+    size_t sectorCount = 0;
+    size_t recordCount = 0;
+    for (size_t offset = 0; offset + SPI_FLASH_SEC_SIZE <= len; offset += SPI_FLASH_SEC_SIZE) {
+        PDM_TraceSectorHeader_t header;
+        memcpy(&header, image + offset, sizeof(header));
+        if (header.magic != PDM_TRACE_MAGIC) {
+            continue;
+        }
+        if (header.recordSize != sizeof(PDM_TraceRecord_t) ||
+            sizeof(header) + header.count * sizeof(PDM_TraceRecord_t) > SPI_FLASH_SEC_SIZE) {
+            fprintf(stderr, "Sector at 0x%zx was written by another firmware (record size %u)\n",
+                    offset, header.recordSize);
+            return 2;
+        }
+        sectors[sectorCount++] = (PDM_ReplaySector_t){header.sequence, offset, header.count};
+        recordCount += header.count;
+    }
+    qsort(sectors, sectorCount, sizeof(sectors[0]), PDMReplay_compareSectors_);
+
+    for (PDM_TransportId_t id = PDM_WIFI; id < PDM_SOURCE_COUNT; id++) {
+        sinks[id].name = "replay";
+        sinks[id].ops = &sinkOps;
+        PDMTransport_register(&sinks[id], id);
+    }
+    size_t tableLen;
+    const PDM_FsmEntry_t *table = PDMApp_table(&tableLen);
+    const uint16_t instanceCount = PDMApp_instanceCount();
+    PDM_FsmState_t *states = malloc(instanceCount * sizeof(PDM_FsmState_t));
+    bool *isSeen = calloc(instanceCount, sizeof(bool));
+    uint16_t *recordedUs = malloc(recordCount * sizeof(uint16_t) + 1);
+    uint16_t *replayedUs = malloc(recordCount * sizeof(uint16_t) + 1);
+    PDM_Fsm_t fsm;
+    PDMFsm_init(&fsm, table, tableLen, states, instanceCount, BT_DISABLED, PDMReplay_observe_);
+
+    size_t replayed = 0, mismatches = 0, resyncs = 0;
+    for (size_t s = 0; s < sectorCount; s++) {
+        for (uint16_t r = 0; r < sectors[s].count; r++) {
+            PDM_TraceRecord_t record;
+            memcpy(&record, image + sectors[s].offset + sizeof(PDM_TraceSectorHeader_t) + r * sizeof(record),
+                   sizeof(record));
+            const bool wasRejected = (record.flags & PDM_TRACE_FLAG_REJECTED) != 0;
+            if (record.instance >= instanceCount || wasRejected) {
+                // Nothing to replay: the instance must still be missing, and only then.
+                if (record.instance < instanceCount || !wasRejected) {
+                    printf("sequence %u record %u: instance %u %s\n", sectors[s].sequence, r, record.instance,
+                           wasRejected ? "rejected, exists now" : "out of range");
+                    mismatches++;
+                }
+                continue;
+            }
+            // A sector overwritten since, or a reset, leaves a gap: start over from what was recorded.
+            if (states[record.instance] != record.prevState) {
+                resyncs += isSeen[record.instance];
+                states[record.instance] = record.prevState;
+            }
+            isSeen[record.instance] = true;
+            const PDM_FsmEvent_t event = {
+                .source = record.source,
+                .data = record.data,
+                .peer = record.peer,
+                .instance = record.instance,
+            };
+            PDMFsm_dispatch(&fsm, &event, 1);
+            PDMTransport_task();
+            const bool wasMatched = (record.flags & PDM_TRACE_FLAG_MATCHED) != 0;
+            if (lastDispatch.matched != wasMatched || lastDispatch.nextState != record.nextState) {
+                printf("sequence %u record %u: source %u peer %u data %u #%u: recorded %u -> %u%s, replayed %u -> %u%s\n",
+                       sectors[s].sequence, r, record.source, record.peer, record.data, record.instance,
+                       record.prevState, record.nextState, wasMatched ? "" : " (unmatched)",
+                       lastDispatch.prevState, lastDispatch.nextState, lastDispatch.matched ? "" : " (unmatched)");
+                mismatches++;
+            }
+            recordedUs[replayed] = record.handlerUs;
+            replayedUs[replayed] = lastDispatch.handlerUs > UINT16_MAX ? UINT16_MAX : lastDispatch.handlerUs;
+            replayed++;
+        }
+    }
+
+    printf("%zu sectors, %zu records replayed, %zu replies, %zu resyncs, %zu mismatches\n",
+           sectorCount, replayed, (size_t)replies, resyncs, mismatches);
+    PDMReplay_printUs_("recorded", recordedUs, replayed);
+    PDMReplay_printUs_("replayed", replayedUs, replayed);
+    return replayed > 0 && mismatches == 0 ? 0 : 1;
+}